@@ -0,0 +1,638 @@
+#include "GradKernel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <opencv2/core/utility.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GK_X86 1
+#include <immintrin.h>
+#else
+#define GK_X86 0
+#endif
+
+// AVX2 实现以函数级目标属性编译，由运行时检测决定是否调用，不要求整个工程开启 -mavx2
+#if GK_X86 && (defined(__GNUC__) || defined(__clang__))
+#define GK_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define GK_TARGET_AVX2
+#endif
+
+namespace GradKernel {
+
+namespace {
+
+// 列方向分块宽度：两行源数据 + 一行参考梯度在分块内保持在 L1/L2 中
+constexpr int kTileCols = 2048;
+
+template<typename T>
+inline const T* rowPtr(const T* base, size_t step, int y)
+{
+    return reinterpret_cast<const T*>(reinterpret_cast<const uint8_t*>(base) + step * static_cast<size_t>(y));
+}
+
+inline const float* refRowPtr(const float* base, size_t step, int y)
+{
+    return reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(base) + step * static_cast<size_t>(y));
+}
+
+// G(x) = |r0[x] - r1[x+1]| + |r0[x+1] - r1[x]|
+template<typename T>
+inline float gradAt(const T* r0, const T* r1, int x)
+{
+    float a = static_cast<float>(r0[x]) - static_cast<float>(r1[x + 1]);
+    float b = static_cast<float>(r0[x + 1]) - static_cast<float>(r1[x]);
+    return std::fabs(a) + std::fabs(b);
+}
+
+/*********
+ * Scalar *
+ *********/
+template<typename T>
+float rowMaxScalar(const T* r0, const T* r1, int x0, int x1, float m)
+{
+    for (int x = x0; x < x1; ++x) m = std::max(m, gradAt(r0, r1, x));
+    return m;
+}
+
+template<typename T>
+void rowDotScalar(const T* r0, const T* r1, const float* ref, int x0, int x1, float thr,
+                  float& dot, float& nsq)
+{
+    float d = 0.f, q = 0.f;
+    for (int x = x0; x < x1; ++x) {
+        float g = gradAt(r0, r1, x);
+        if (g > thr) {
+            d += g * ref[x];
+            q += g * g;
+        }
+    }
+    dot = d;
+    nsq = q;
+}
+
+template<typename T>
+void rowGradScalar(const T* r0, const T* r1, float* out, int x0, int x1, float thr)
+{
+    for (int x = x0; x < x1; ++x) {
+        float g = gradAt(r0, r1, x);
+        out[x] = g > thr ? g : 0.f;
+    }
+}
+
+#if GK_X86
+inline float hmax(__m128 v)
+{
+    v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    return _mm_cvtss_f32(v);
+}
+
+inline float hsum(__m128 v)
+{
+    v = _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    v = _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    return _mm_cvtss_f32(v);
+}
+
+/*******
+ * SSE2 *
+ *******/
+inline __m128 gradF32Sse(const float* r0, const float* r1, int x)
+{
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 d1 = _mm_sub_ps(_mm_loadu_ps(r0 + x), _mm_loadu_ps(r1 + x + 1));
+    __m128 d2 = _mm_sub_ps(_mm_loadu_ps(r0 + x + 1), _mm_loadu_ps(r1 + x));
+    return _mm_add_ps(_mm_andnot_ps(sign, d1), _mm_andnot_ps(sign, d2));
+}
+
+float rowMaxF32Sse(const float* r0, const float* r1, int x0, int x1, float m)
+{
+    __m128 vmax = _mm_set1_ps(m);
+    int x = x0;
+    for (; x + 4 <= x1; x += 4) vmax = _mm_max_ps(vmax, gradF32Sse(r0, r1, x));
+    return rowMaxScalar(r0, r1, x, x1, hmax(vmax));
+}
+
+void rowDotF32Sse(const float* r0, const float* r1, const float* ref, int x0, int x1, float thr,
+                  float& dot, float& nsq)
+{
+    const __m128 vthr = _mm_set1_ps(thr);
+    __m128 accD = _mm_setzero_ps(), accQ = _mm_setzero_ps();
+    int x = x0;
+    for (; x + 4 <= x1; x += 4) {
+        __m128 g = gradF32Sse(r0, r1, x);
+        g = _mm_and_ps(g, _mm_cmpgt_ps(g, vthr));
+        accD = _mm_add_ps(accD, _mm_mul_ps(g, _mm_loadu_ps(ref + x)));
+        accQ = _mm_add_ps(accQ, _mm_mul_ps(g, g));
+    }
+    float d, q;
+    rowDotScalar(r0, r1, ref, x, x1, thr, d, q);
+    dot = hsum(accD) + d;
+    nsq = hsum(accQ) + q;
+}
+
+// 16 个像素的 8 位梯度，拆为高低两组 int16
+inline void gradU8Sse(const uint8_t* r0, const uint8_t* r1, int x, __m128i& lo, __m128i& hi)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r0 + x));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r1 + x + 1));
+    __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r0 + x + 1));
+    __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r1 + x));
+    __m128i ad1 = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+    __m128i ad2 = _mm_or_si128(_mm_subs_epu8(c, d), _mm_subs_epu8(d, c));
+    lo = _mm_add_epi16(_mm_unpacklo_epi8(ad1, zero), _mm_unpacklo_epi8(ad2, zero));
+    hi = _mm_add_epi16(_mm_unpackhi_epi8(ad1, zero), _mm_unpackhi_epi8(ad2, zero));
+}
+
+float rowMaxU8Sse(const uint8_t* r0, const uint8_t* r1, int x0, int x1, float m)
+{
+    __m128i vmax = _mm_setzero_si128();
+    int x = x0;
+    for (; x + 16 <= x1; x += 16) {
+        __m128i lo, hi;
+        gradU8Sse(r0, r1, x, lo, hi);
+        vmax = _mm_max_epi16(vmax, _mm_max_epi16(lo, hi));
+    }
+    alignas(16) int16_t buf[8];
+    _mm_store_si128(reinterpret_cast<__m128i*>(buf), vmax);
+    for (int16_t v : buf) m = std::max(m, static_cast<float>(v));
+    return rowMaxScalar(r0, r1, x, x1, m);
+}
+
+inline void accumU8Sse(__m128i g16, const float* ref, __m128 vthr, __m128& accD, __m128& accQ)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128 g0 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(g16, zero));
+    __m128 g1 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(g16, zero));
+    g0 = _mm_and_ps(g0, _mm_cmpgt_ps(g0, vthr));
+    g1 = _mm_and_ps(g1, _mm_cmpgt_ps(g1, vthr));
+    accD = _mm_add_ps(accD, _mm_add_ps(_mm_mul_ps(g0, _mm_loadu_ps(ref)), _mm_mul_ps(g1, _mm_loadu_ps(ref + 4))));
+    accQ = _mm_add_ps(accQ, _mm_add_ps(_mm_mul_ps(g0, g0), _mm_mul_ps(g1, g1)));
+}
+
+void rowDotU8Sse(const uint8_t* r0, const uint8_t* r1, const float* ref, int x0, int x1, float thr,
+                 float& dot, float& nsq)
+{
+    const __m128 vthr = _mm_set1_ps(thr);
+    __m128 accD = _mm_setzero_ps(), accQ = _mm_setzero_ps();
+    int x = x0;
+    for (; x + 16 <= x1; x += 16) {
+        __m128i lo, hi;
+        gradU8Sse(r0, r1, x, lo, hi);
+        accumU8Sse(lo, ref + x, vthr, accD, accQ);
+        accumU8Sse(hi, ref + x + 8, vthr, accD, accQ);
+    }
+    float d, q;
+    rowDotScalar(r0, r1, ref, x, x1, thr, d, q);
+    dot = hsum(accD) + d;
+    nsq = hsum(accQ) + q;
+}
+
+// 8 个像素的 16 位梯度：饱和减法求绝对差后拓宽为两组 int32（和最大 131070，超出 int16）
+inline void gradU16Sse(const uint16_t* r0, const uint16_t* r1, int x, __m128i& lo, __m128i& hi)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r0 + x));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r1 + x + 1));
+    __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r0 + x + 1));
+    __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r1 + x));
+    __m128i ad1 = _mm_or_si128(_mm_subs_epu16(a, b), _mm_subs_epu16(b, a));
+    __m128i ad2 = _mm_or_si128(_mm_subs_epu16(c, d), _mm_subs_epu16(d, c));
+    lo = _mm_add_epi32(_mm_unpacklo_epi16(ad1, zero), _mm_unpacklo_epi16(ad2, zero));
+    hi = _mm_add_epi32(_mm_unpackhi_epi16(ad1, zero), _mm_unpackhi_epi16(ad2, zero));
+}
+
+// SSE2 没有 pmaxsd，以比较加选择代替
+inline __m128i maxEpi32Sse(__m128i a, __m128i b)
+{
+    __m128i gt = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(gt, a), _mm_andnot_si128(gt, b));
+}
+
+float rowMaxU16Sse(const uint16_t* r0, const uint16_t* r1, int x0, int x1, float m)
+{
+    __m128i vmax = _mm_setzero_si128();
+    int x = x0;
+    for (; x + 8 <= x1; x += 8) {
+        __m128i lo, hi;
+        gradU16Sse(r0, r1, x, lo, hi);
+        vmax = maxEpi32Sse(vmax, maxEpi32Sse(lo, hi));
+    }
+    alignas(16) int32_t buf[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(buf), vmax);
+    for (int32_t v : buf) m = std::max(m, static_cast<float>(v));
+    return rowMaxScalar(r0, r1, x, x1, m);
+}
+
+inline void accumF32Sse(__m128 g, const float* ref, __m128 vthr, __m128& accD, __m128& accQ)
+{
+    g = _mm_and_ps(g, _mm_cmpgt_ps(g, vthr));
+    accD = _mm_add_ps(accD, _mm_mul_ps(g, _mm_loadu_ps(ref)));
+    accQ = _mm_add_ps(accQ, _mm_mul_ps(g, g));
+}
+
+void rowDotU16Sse(const uint16_t* r0, const uint16_t* r1, const float* ref, int x0, int x1, float thr,
+                  float& dot, float& nsq)
+{
+    const __m128 vthr = _mm_set1_ps(thr);
+    __m128 accD = _mm_setzero_ps(), accQ = _mm_setzero_ps();
+    int x = x0;
+    for (; x + 8 <= x1; x += 8) {
+        __m128i lo, hi;
+        gradU16Sse(r0, r1, x, lo, hi);
+        accumF32Sse(_mm_cvtepi32_ps(lo), ref + x, vthr, accD, accQ);
+        accumF32Sse(_mm_cvtepi32_ps(hi), ref + x + 4, vthr, accD, accQ);
+    }
+    float d, q;
+    rowDotScalar(r0, r1, ref, x, x1, thr, d, q);
+    dot = hsum(accD) + d;
+    nsq = hsum(accQ) + q;
+}
+
+inline void storeThrSse(float* out, __m128 g, __m128 vthr)
+{
+    _mm_storeu_ps(out, _mm_and_ps(g, _mm_cmpgt_ps(g, vthr)));
+}
+
+void rowGradF32Sse(const float* r0, const float* r1, float* out, int x0, int x1, float thr)
+{
+    const __m128 vthr = _mm_set1_ps(thr);
+    int x = x0;
+    for (; x + 4 <= x1; x += 4) storeThrSse(out + x, gradF32Sse(r0, r1, x), vthr);
+    rowGradScalar(r0, r1, out, x, x1, thr);
+}
+
+void rowGradU8Sse(const uint8_t* r0, const uint8_t* r1, float* out, int x0, int x1, float thr)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 vthr = _mm_set1_ps(thr);
+    int x = x0;
+    for (; x + 16 <= x1; x += 16) {
+        __m128i lo, hi;
+        gradU8Sse(r0, r1, x, lo, hi);
+        storeThrSse(out + x,      _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), vthr);
+        storeThrSse(out + x + 4,  _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), vthr);
+        storeThrSse(out + x + 8,  _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), vthr);
+        storeThrSse(out + x + 12, _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), vthr);
+    }
+    rowGradScalar(r0, r1, out, x, x1, thr);
+}
+
+void rowGradU16Sse(const uint16_t* r0, const uint16_t* r1, float* out, int x0, int x1, float thr)
+{
+    const __m128 vthr = _mm_set1_ps(thr);
+    int x = x0;
+    for (; x + 8 <= x1; x += 8) {
+        __m128i lo, hi;
+        gradU16Sse(r0, r1, x, lo, hi);
+        storeThrSse(out + x, _mm_cvtepi32_ps(lo), vthr);
+        storeThrSse(out + x + 4, _mm_cvtepi32_ps(hi), vthr);
+    }
+    rowGradScalar(r0, r1, out, x, x1, thr);
+}
+
+/*******
+ * AVX2 *
+ *******/
+GK_TARGET_AVX2 inline __m256 gradF32Avx(const float* r0, const float* r1, int x)
+{
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(r0 + x), _mm256_loadu_ps(r1 + x + 1));
+    __m256 d2 = _mm256_sub_ps(_mm256_loadu_ps(r0 + x + 1), _mm256_loadu_ps(r1 + x));
+    return _mm256_add_ps(_mm256_andnot_ps(sign, d1), _mm256_andnot_ps(sign, d2));
+}
+
+GK_TARGET_AVX2 float rowMaxF32Avx(const float* r0, const float* r1, int x0, int x1, float m)
+{
+    __m256 vmax = _mm256_set1_ps(m);
+    int x = x0;
+    for (; x + 8 <= x1; x += 8) vmax = _mm256_max_ps(vmax, gradF32Avx(r0, r1, x));
+    __m128 v = _mm_max_ps(_mm256_castps256_ps128(vmax), _mm256_extractf128_ps(vmax, 1));
+    return rowMaxScalar(r0, r1, x, x1, hmax(v));
+}
+
+GK_TARGET_AVX2 void rowDotF32Avx(const float* r0, const float* r1, const float* ref, int x0, int x1, float thr,
+                                 float& dot, float& nsq)
+{
+    const __m256 vthr = _mm256_set1_ps(thr);
+    __m256 accD = _mm256_setzero_ps(), accQ = _mm256_setzero_ps();
+    int x = x0;
+    for (; x + 8 <= x1; x += 8) {
+        __m256 g = gradF32Avx(r0, r1, x);
+        g = _mm256_and_ps(g, _mm256_cmp_ps(g, vthr, _CMP_GT_OQ));
+        accD = _mm256_add_ps(accD, _mm256_mul_ps(g, _mm256_loadu_ps(ref + x)));
+        accQ = _mm256_add_ps(accQ, _mm256_mul_ps(g, g));
+    }
+    float d, q;
+    rowDotScalar(r0, r1, ref, x, x1, thr, d, q);
+    dot = hsum(_mm_add_ps(_mm256_castps256_ps128(accD), _mm256_extractf128_ps(accD, 1))) + d;
+    nsq = hsum(_mm_add_ps(_mm256_castps256_ps128(accQ), _mm256_extractf128_ps(accQ, 1))) + q;
+}
+
+GK_TARGET_AVX2 inline __m256i gradU8Avx(const uint8_t* r0, const uint8_t* r1, int x)
+{
+    __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(r0 + x)));
+    __m256i b = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(r1 + x + 1)));
+    __m256i c = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(r0 + x + 1)));
+    __m256i d = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(r1 + x)));
+    return _mm256_add_epi16(_mm256_abs_epi16(_mm256_sub_epi16(a, b)),
+                            _mm256_abs_epi16(_mm256_sub_epi16(c, d)));
+}
+
+GK_TARGET_AVX2 float rowMaxU8Avx(const uint8_t* r0, const uint8_t* r1, int x0, int x1, float m)
+{
+    __m256i vmax = _mm256_setzero_si256();
+    int x = x0;
+    for (; x + 16 <= x1; x += 16) vmax = _mm256_max_epi16(vmax, gradU8Avx(r0, r1, x));
+    alignas(32) int16_t buf[16];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(buf), vmax);
+    for (int16_t v : buf) m = std::max(m, static_cast<float>(v));
+    return rowMaxScalar(r0, r1, x, x1, m);
+}
+
+GK_TARGET_AVX2 void rowDotU8Avx(const uint8_t* r0, const uint8_t* r1, const float* ref, int x0, int x1, float thr,
+                                float& dot, float& nsq)
+{
+    const __m256 vthr = _mm256_set1_ps(thr);
+    __m256 accD = _mm256_setzero_ps(), accQ = _mm256_setzero_ps();
+    int x = x0;
+    for (; x + 16 <= x1; x += 16) {
+        __m256i g16 = gradU8Avx(r0, r1, x);
+        __m256 g0 = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(g16)));
+        __m256 g1 = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(g16, 1)));
+        g0 = _mm256_and_ps(g0, _mm256_cmp_ps(g0, vthr, _CMP_GT_OQ));
+        g1 = _mm256_and_ps(g1, _mm256_cmp_ps(g1, vthr, _CMP_GT_OQ));
+        accD = _mm256_add_ps(accD, _mm256_add_ps(_mm256_mul_ps(g0, _mm256_loadu_ps(ref + x)),
+                                                 _mm256_mul_ps(g1, _mm256_loadu_ps(ref + x + 8))));
+        accQ = _mm256_add_ps(accQ, _mm256_add_ps(_mm256_mul_ps(g0, g0), _mm256_mul_ps(g1, g1)));
+    }
+    float d, q;
+    rowDotScalar(r0, r1, ref, x, x1, thr, d, q);
+    dot = hsum(_mm_add_ps(_mm256_castps256_ps128(accD), _mm256_extractf128_ps(accD, 1))) + d;
+    nsq = hsum(_mm_add_ps(_mm256_castps256_ps128(accQ), _mm256_extractf128_ps(accQ, 1))) + q;
+}
+
+// 16 个像素的 16 位梯度，拓宽为两组 8 x int32
+GK_TARGET_AVX2 inline void gradU16Avx(const uint16_t* r0, const uint16_t* r1, int x, __m256i& lo, __m256i& hi)
+{
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(r0 + x));
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(r1 + x + 1));
+    __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(r0 + x + 1));
+    __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(r1 + x));
+    __m256i ad1 = _mm256_or_si256(_mm256_subs_epu16(a, b), _mm256_subs_epu16(b, a));
+    __m256i ad2 = _mm256_or_si256(_mm256_subs_epu16(c, d), _mm256_subs_epu16(d, c));
+    lo = _mm256_add_epi32(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(ad1)),
+                          _mm256_cvtepu16_epi32(_mm256_castsi256_si128(ad2)));
+    hi = _mm256_add_epi32(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(ad1, 1)),
+                          _mm256_cvtepu16_epi32(_mm256_extracti128_si256(ad2, 1)));
+}
+
+GK_TARGET_AVX2 float rowMaxU16Avx(const uint16_t* r0, const uint16_t* r1, int x0, int x1, float m)
+{
+    __m256i vmax = _mm256_setzero_si256();
+    int x = x0;
+    for (; x + 16 <= x1; x += 16) {
+        __m256i lo, hi;
+        gradU16Avx(r0, r1, x, lo, hi);
+        vmax = _mm256_max_epi32(vmax, _mm256_max_epi32(lo, hi));
+    }
+    alignas(32) int32_t buf[8];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(buf), vmax);
+    for (int32_t v : buf) m = std::max(m, static_cast<float>(v));
+    return rowMaxScalar(r0, r1, x, x1, m);
+}
+
+GK_TARGET_AVX2 inline void accumF32Avx(__m256 g, const float* ref, __m256 vthr, __m256& accD, __m256& accQ)
+{
+    g = _mm256_and_ps(g, _mm256_cmp_ps(g, vthr, _CMP_GT_OQ));
+    accD = _mm256_add_ps(accD, _mm256_mul_ps(g, _mm256_loadu_ps(ref)));
+    accQ = _mm256_add_ps(accQ, _mm256_mul_ps(g, g));
+}
+
+GK_TARGET_AVX2 void rowDotU16Avx(const uint16_t* r0, const uint16_t* r1, const float* ref, int x0, int x1, float thr,
+                                 float& dot, float& nsq)
+{
+    const __m256 vthr = _mm256_set1_ps(thr);
+    __m256 accD = _mm256_setzero_ps(), accQ = _mm256_setzero_ps();
+    int x = x0;
+    for (; x + 16 <= x1; x += 16) {
+        __m256i lo, hi;
+        gradU16Avx(r0, r1, x, lo, hi);
+        accumF32Avx(_mm256_cvtepi32_ps(lo), ref + x, vthr, accD, accQ);
+        accumF32Avx(_mm256_cvtepi32_ps(hi), ref + x + 8, vthr, accD, accQ);
+    }
+    float d, q;
+    rowDotScalar(r0, r1, ref, x, x1, thr, d, q);
+    dot = hsum(_mm_add_ps(_mm256_castps256_ps128(accD), _mm256_extractf128_ps(accD, 1))) + d;
+    nsq = hsum(_mm_add_ps(_mm256_castps256_ps128(accQ), _mm256_extractf128_ps(accQ, 1))) + q;
+}
+
+GK_TARGET_AVX2 inline void storeThrAvx(float* out, __m256 g, __m256 vthr)
+{
+    _mm256_storeu_ps(out, _mm256_and_ps(g, _mm256_cmp_ps(g, vthr, _CMP_GT_OQ)));
+}
+
+GK_TARGET_AVX2 void rowGradF32Avx(const float* r0, const float* r1, float* out, int x0, int x1, float thr)
+{
+    const __m256 vthr = _mm256_set1_ps(thr);
+    int x = x0;
+    for (; x + 8 <= x1; x += 8) storeThrAvx(out + x, gradF32Avx(r0, r1, x), vthr);
+    rowGradScalar(r0, r1, out, x, x1, thr);
+}
+
+GK_TARGET_AVX2 void rowGradU8Avx(const uint8_t* r0, const uint8_t* r1, float* out, int x0, int x1, float thr)
+{
+    const __m256 vthr = _mm256_set1_ps(thr);
+    int x = x0;
+    for (; x + 16 <= x1; x += 16) {
+        __m256i g16 = gradU8Avx(r0, r1, x);
+        storeThrAvx(out + x, _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(g16))), vthr);
+        storeThrAvx(out + x + 8, _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(g16, 1))), vthr);
+    }
+    rowGradScalar(r0, r1, out, x, x1, thr);
+}
+
+GK_TARGET_AVX2 void rowGradU16Avx(const uint16_t* r0, const uint16_t* r1, float* out, int x0, int x1, float thr)
+{
+    const __m256 vthr = _mm256_set1_ps(thr);
+    int x = x0;
+    for (; x + 16 <= x1; x += 16) {
+        __m256i lo, hi;
+        gradU16Avx(r0, r1, x, lo, hi);
+        storeThrAvx(out + x, _mm256_cvtepi32_ps(lo), vthr);
+        storeThrAvx(out + x + 8, _mm256_cvtepi32_ps(hi), vthr);
+    }
+    rowGradScalar(r0, r1, out, x, x1, thr);
+}
+#endif // GK_X86
+
+/***********
+ * Dispatch *
+ ***********/
+enum class Isa { Scalar, SSE2, AVX2 };
+
+Isa currentIsa()
+{
+    static const Isa isa = [] {
+#if GK_X86
+        if (cv::checkHardwareSupport(CV_CPU_AVX2)) return Isa::AVX2;
+        return Isa::SSE2;
+#else
+        return Isa::Scalar;
+#endif
+    }();
+    return isa;
+}
+
+template<typename T>
+using RowMaxFn = float (*)(const T*, const T*, int, int, float);
+template<typename T>
+using RowDotFn = void (*)(const T*, const T*, const float*, int, int, float, float&, float&);
+
+template<typename T>
+using RowGradFn = void (*)(const T*, const T*, float*, int, int, float);
+
+template<typename T>
+float gradientMaxImpl(const T* src, size_t step, int rows, int cols, RowMaxFn<T> fn)
+{
+    float m = 0.f; // 梯度非负
+    const int n = cols - 1;
+    for (int y = 0; y + 1 < rows; ++y) m = fn(rowPtr(src, step, y), rowPtr(src, step, y + 1), 0, n, m);
+    return m;
+}
+
+template<typename T>
+DotResult thresholdedDotImpl(const T* src, size_t step, int rows, int cols, float thresh,
+                             const float* ref, size_t refStep, RowDotFn<T> fn)
+{
+    DotResult res;
+    const int n = cols - 1;
+    for (int x0 = 0; x0 < n; x0 += kTileCols) {
+        const int x1 = std::min(n, x0 + kTileCols);
+        for (int y = 0; y + 1 < rows; ++y) {
+            float d, q;
+            fn(rowPtr(src, step, y), rowPtr(src, step, y + 1), refRowPtr(ref, refStep, y), x0, x1, thresh, d, q);
+            res.dot += d;
+            res.normSq += q;
+        }
+    }
+    return res;
+}
+
+template<typename T>
+void thresholdedGradientImpl(const T* src, size_t step, int rows, int cols, float thresh,
+                             float* dst, size_t dstStep, RowGradFn<T> fn)
+{
+    const int n = cols - 1;
+    for (int y = 0; y + 1 < rows; ++y) {
+        float* out = reinterpret_cast<float*>(reinterpret_cast<uint8_t*>(dst) + dstStep * static_cast<size_t>(y));
+        fn(rowPtr(src, step, y), rowPtr(src, step, y + 1), out, 0, n, thresh);
+    }
+}
+
+} // namespace
+
+// 各元素类型的行函数按指令集选择；三组公共入口共用同一分派
+#if GK_X86
+#define GK_DISPATCH(avx, sse, scalar) (currentIsa() == Isa::AVX2 ? (avx) : (sse))
+#else
+#define GK_DISPATCH(avx, sse, scalar) (scalar)
+#endif
+
+float gradientMax(const uint16_t* src, size_t step, int rows, int cols)
+{
+    if (rows < 2 || cols < 2) return 0.f;
+    return gradientMaxImpl<uint16_t>(src, step, rows, cols,
+                                     GK_DISPATCH(rowMaxU16Avx, rowMaxU16Sse, rowMaxScalar<uint16_t>));
+}
+
+DotResult thresholdedDot(const uint16_t* src, size_t step, int rows, int cols,
+                         float thresh, const float* ref, size_t refStep)
+{
+    if (rows < 2 || cols < 2) return DotResult();
+    return thresholdedDotImpl<uint16_t>(src, step, rows, cols, thresh, ref, refStep,
+                                        GK_DISPATCH(rowDotU16Avx, rowDotU16Sse, rowDotScalar<uint16_t>));
+}
+
+void thresholdedGradient(const uint8_t* src, size_t step, int rows, int cols, float thresh,
+                         float* dst, size_t dstStep)
+{
+    if (rows < 2 || cols < 2) return;
+    thresholdedGradientImpl<uint8_t>(src, step, rows, cols, thresh, dst, dstStep,
+                                     GK_DISPATCH(rowGradU8Avx, rowGradU8Sse, rowGradScalar<uint8_t>));
+}
+
+void thresholdedGradient(const uint16_t* src, size_t step, int rows, int cols, float thresh,
+                         float* dst, size_t dstStep)
+{
+    if (rows < 2 || cols < 2) return;
+    thresholdedGradientImpl<uint16_t>(src, step, rows, cols, thresh, dst, dstStep,
+                                      GK_DISPATCH(rowGradU16Avx, rowGradU16Sse, rowGradScalar<uint16_t>));
+}
+
+void thresholdedGradient(const float* src, size_t step, int rows, int cols, float thresh,
+                         float* dst, size_t dstStep)
+{
+    if (rows < 2 || cols < 2) return;
+    thresholdedGradientImpl<float>(src, step, rows, cols, thresh, dst, dstStep,
+                                   GK_DISPATCH(rowGradF32Avx, rowGradF32Sse, rowGradScalar<float>));
+}
+
+float gradientMax(const uint8_t* src, size_t step, int rows, int cols)
+{
+    if (rows < 2 || cols < 2) return 0.f;
+#if GK_X86
+    if (currentIsa() == Isa::AVX2) return gradientMaxImpl<uint8_t>(src, step, rows, cols, rowMaxU8Avx);
+    return gradientMaxImpl<uint8_t>(src, step, rows, cols, rowMaxU8Sse);
+#else
+    return gradientMaxImpl<uint8_t>(src, step, rows, cols, rowMaxScalar<uint8_t>);
+#endif
+}
+
+float gradientMax(const float* src, size_t step, int rows, int cols)
+{
+    if (rows < 2 || cols < 2) return 0.f;
+#if GK_X86
+    if (currentIsa() == Isa::AVX2) return gradientMaxImpl<float>(src, step, rows, cols, rowMaxF32Avx);
+    return gradientMaxImpl<float>(src, step, rows, cols, rowMaxF32Sse);
+#else
+    return gradientMaxImpl<float>(src, step, rows, cols, rowMaxScalar<float>);
+#endif
+}
+
+DotResult thresholdedDot(const uint8_t* src, size_t step, int rows, int cols,
+                         float thresh, const float* ref, size_t refStep)
+{
+    if (rows < 2 || cols < 2) return DotResult();
+#if GK_X86
+    if (currentIsa() == Isa::AVX2) return thresholdedDotImpl<uint8_t>(src, step, rows, cols, thresh, ref, refStep, rowDotU8Avx);
+    return thresholdedDotImpl<uint8_t>(src, step, rows, cols, thresh, ref, refStep, rowDotU8Sse);
+#else
+    return thresholdedDotImpl<uint8_t>(src, step, rows, cols, thresh, ref, refStep, rowDotScalar<uint8_t>);
+#endif
+}
+
+DotResult thresholdedDot(const float* src, size_t step, int rows, int cols,
+                         float thresh, const float* ref, size_t refStep)
+{
+    if (rows < 2 || cols < 2) return DotResult();
+#if GK_X86
+    if (currentIsa() == Isa::AVX2) return thresholdedDotImpl<float>(src, step, rows, cols, thresh, ref, refStep, rowDotF32Avx);
+    return thresholdedDotImpl<float>(src, step, rows, cols, thresh, ref, refStep, rowDotF32Sse);
+#else
+    return thresholdedDotImpl<float>(src, step, rows, cols, thresh, ref, refStep, rowDotScalar<float>);
+#endif
+}
+
+const char* isaName()
+{
+    switch (currentIsa()) {
+    case Isa::AVX2: return "AVX2";
+    case Isa::SSE2: return "SSE2";
+    default: return "Scalar";
+    }
+}
+
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief 融合梯度核
+ * 将 preTreat 的 Roberts 型梯度 G = |f(x,y)-f(x+1,y+1)| + |f(x+1,y)-f(x,y+1)|、
+ * 最大值统计、阈值化（THRESH_TOZERO）以及与参考梯度的点积/平方和累加
+ * 融合为两遍只读的流式扫描，不生成 diff1/diff2/grad 等整帧临时图。
+ *
+ * 梯度图尺寸为 (rows-1) x (cols-1)；step / refStep 均以字节为单位。
+ * 运行时按 CPU 能力选择 AVX2 / SSE2 / 标量实现。
+ */
+namespace GradKernel {
+
+struct DotResult {
+    double dot = 0.0;     // sum(G_thr * ref)
+    double normSq = 0.0;  // sum(G_thr^2)
+};
+
+// 第一遍：梯度最大值（整型输入以整型 SIMD 求绝对差并拓宽累加）
+float gradientMax(const uint8_t* src, size_t step, int rows, int cols);
+float gradientMax(const uint16_t* src, size_t step, int rows, int cols);
+float gradientMax(const float* src, size_t step, int rows, int cols);
+
+// 第二遍：以 thresh 做 TOZERO 阈值化后，与参考梯度累加点积与平方和
+DotResult thresholdedDot(const uint8_t* src, size_t step, int rows, int cols,
+                         float thresh, const float* ref, size_t refStep);
+DotResult thresholdedDot(const uint16_t* src, size_t step, int rows, int cols,
+                         float thresh, const float* ref, size_t refStep);
+DotResult thresholdedDot(const float* src, size_t step, int rows, int cols,
+                         float thresh, const float* ref, size_t refStep);
+
+// 第二遍的写出版本：阈值化后的梯度图写入 dst（CV_32F，(rows-1) x (cols-1)），等价于 preTreat
+void thresholdedGradient(const uint8_t* src, size_t step, int rows, int cols, float thresh,
+                         float* dst, size_t dstStep);
+void thresholdedGradient(const uint16_t* src, size_t step, int rows, int cols, float thresh,
+                         float* dst, size_t dstStep);
+void thresholdedGradient(const float* src, size_t step, int rows, int cols, float thresh,
+                         float* dst, size_t dstStep);
+
+// 当前选用的指令集名称（"AVX2" / "SSE2" / "Scalar"）
+const char* isaName();
+
+}
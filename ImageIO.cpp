@@ -0,0 +1,561 @@
+#include "ImageIO.h"
+#include <QSysInfo>
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <set>
+
+#ifdef DIP_HAVE_PNG
+#include <png.h>
+#include <csetjmp>
+#endif
+
+namespace ImageIO {
+
+namespace {
+
+constexpr qint64 kPageSize = 4096;
+constexpr bool kHostBigEndian = QSysInfo::ByteOrder == QSysInfo::BigEndian;
+// 保留 12/16 位相机数据的动态范围
+constexpr int kDecodeFlags = cv::IMREAD_GRAYSCALE | cv::IMREAD_ANYDEPTH;
+
+inline quint16 le16(const uchar* p) { return quint16(p[0] | (p[1] << 8)); }
+inline quint32 le32(const uchar* p) { return quint32(p[0]) | (quint32(p[1]) << 8) | (quint32(p[2]) << 16) | (quint32(p[3]) << 24); }
+
+// 与 imgcodecs 的调色板转灰度一致：14 位定点 BGR 加权
+inline uchar paletteGray(uchar b, uchar g, uchar r)
+{
+    return static_cast<uchar>((b * 1868 + g * 9617 + r * 4899 + (1 << 13)) >> 14);
+}
+
+bool rasterFits(qint64 size, const RasterLayout& l)
+{
+    if (l.rows <= 0 || l.cols <= 0 || l.offset < 0) return false;
+    if (l.step < static_cast<size_t>(l.cols) * l.pixelBytes()) return false;
+    return l.offset + static_cast<qint64>(l.step) * l.rows <= size;
+}
+
+// BITMAPFILEHEADER + BITMAPINFOHEADER（及 V4/V5 扩展），仅 BI_RGB 的 8/24/32 位
+bool probeBMP(const uchar* data, qint64 size, RasterLayout& l)
+{
+    if (size < 54 || data[0] != 'B' || data[1] != 'M') return false;
+    const quint32 offBits = le32(data + 10);
+    const quint32 infoSize = le32(data + 14);
+    if (infoSize < 40 || 14 + qint64(infoSize) > size) return false;
+
+    const qint32 width = static_cast<qint32>(le32(data + 18));
+    const qint32 height = static_cast<qint32>(le32(data + 22));
+    const quint16 bitCount = le16(data + 28);
+    const quint32 compression = le32(data + 30);
+    if (compression != 0 || width <= 0 || height == 0 || height == INT32_MIN) return false;
+    if (bitCount != 8 && bitCount != 24 && bitCount != 32) return false;
+
+    l = RasterLayout();
+    l.offset = offBits;
+    l.cols = width;
+    l.rows = height > 0 ? height : -height;
+    l.bottomUp = height > 0;
+    l.channels = bitCount / 8;
+    l.step = (static_cast<size_t>(width) * bitCount / 8 + 3) & ~size_t(3);
+
+    if (bitCount == 8) {
+        quint32 colors = le32(data + 46);
+        if (colors == 0 || colors > 256) colors = 256;
+        const qint64 paletteOff = 14 + infoSize;
+        if (paletteOff + 4 * qint64(colors) > size) return false;
+
+        cv::Mat lut(1, 256, CV_8U, cv::Scalar(0));
+        bool identity = colors == 256;
+        const uchar* pal = data + paletteOff;
+        for (quint32 i = 0; i < colors; ++i) {
+            uchar g = paletteGray(pal[4 * i], pal[4 * i + 1], pal[4 * i + 2]);
+            lut.at<uchar>(static_cast<int>(i)) = g;
+            identity = identity && g == i;
+        }
+        if (!identity) l.lut = lut;
+    }
+    return rasterFits(size, l);
+}
+
+// 二进制 PGM（P5）：maxval == 255 为 8 位；256..65535 为大端 16 位
+bool probePGM(const uchar* data, qint64 size, RasterLayout& l)
+{
+    if (size < 8 || data[0] != 'P' || data[1] != '5') return false;
+    qint64 pos = 2;
+    int fields[3] = {0, 0, 0};
+    for (int& field : fields) {
+        // 跳过空白与注释
+        while (pos < size && (std::isspace(data[pos]) || data[pos] == '#')) {
+            if (data[pos] == '#') while (pos < size && data[pos] != '\n') ++pos;
+            else ++pos;
+        }
+        if (pos >= size || !std::isdigit(data[pos])) return false;
+        qint64 v = 0;
+        while (pos < size && std::isdigit(data[pos]) && v <= INT32_MAX) v = v * 10 + (data[pos++] - '0');
+        if (v <= 0 || v > INT32_MAX) return false;
+        field = static_cast<int>(v);
+    }
+    // maxval 之后恰好一个空白字符
+    // maxval < 255 时 imgcodecs 会按比例拉伸，交给解码器
+    if (pos >= size || !std::isspace(data[pos]) || fields[2] < 255 || fields[2] > 65535) return false;
+
+    l = RasterLayout();
+    l.offset = pos + 1;
+    l.cols = fields[0];
+    l.rows = fields[1];
+    if (fields[2] > 255) {
+        l.depth = CV_16U;
+        l.swapBytes = !kHostBigEndian;
+    }
+    l.step = static_cast<size_t>(l.cols) * l.pixelBytes();
+    return rasterFits(size, l);
+}
+
+// TIFF 头与 IFD 读取，支持 II / MM 两种字节序（不含 BigTIFF）
+class TiffReader {
+public:
+    TiffReader(const uchar* data, qint64 size) : m_data(data), m_size(size) {
+        m_valid = size >= 8 && ((data[0] == 'I' && data[1] == 'I') || (data[0] == 'M' && data[1] == 'M'));
+        m_be = m_valid && data[0] == 'M';
+        m_valid = m_valid && u16(2) == 42;
+    }
+    bool valid() const { return m_valid; }
+    bool bigEndian() const { return m_be; }
+    quint32 firstIFD() const { return u32(4); }
+
+    quint16 u16(qint64 off) const {
+        if (off < 0 || off + 2 > m_size) return 0;
+        const uchar* p = m_data + off;
+        return m_be ? quint16((p[0] << 8) | p[1]) : le16(p);
+    }
+    quint32 u32(qint64 off) const {
+        if (off < 0 || off + 4 > m_size) return 0;
+        const uchar* p = m_data + off;
+        return m_be ? (quint32(p[0]) << 24) | (quint32(p[1]) << 16) | (quint32(p[2]) << 8) | quint32(p[3]) : le32(p);
+    }
+
+    struct Entry { quint16 tag = 0, type = 0; quint32 count = 0; qint64 pos = 0; };
+
+    // 第 i 个值（BYTE / SHORT / LONG），越界返回 false
+    bool value(const Entry& e, quint32 i, quint32& v) const {
+        const int size = e.type == 1 ? 1 : e.type == 3 ? 2 : e.type == 4 ? 4 : 0;
+        if (size == 0 || i >= e.count) return false;
+        // 总长不超过 4 字节时值直接存放在条目内
+        const qint64 base = qint64(e.count) * size <= 4 ? e.pos + 8 : qint64(u32(e.pos + 8));
+        const qint64 off = base + qint64(i) * size;
+        if (off + size > m_size) return false;
+        v = size == 1 ? m_data[off] : size == 2 ? u16(off) : u32(off);
+        return true;
+    }
+
+    // 解析 ifd 处的目录，返回条目表与下一目录偏移
+    bool readIFD(quint32 ifd, std::vector<Entry>& entries, quint32& next) const {
+        const quint16 n = u16(ifd);
+        if (ifd < 8 || qint64(ifd) + 2 + qint64(n) * 12 + 4 > m_size) return false;
+        entries.resize(n);
+        for (quint16 k = 0; k < n; ++k) {
+            const qint64 pos = qint64(ifd) + 2 + qint64(k) * 12;
+            entries[k] = {u16(pos), u16(pos + 2), u32(pos + 4), pos};
+        }
+        next = u32(qint64(ifd) + 2 + qint64(n) * 12);
+        return true;
+    }
+
+private:
+    const uchar* m_data;
+    qint64 m_size;
+    bool m_be = false;
+    bool m_valid = false;
+};
+
+// 未压缩、单通道 8/16 位、BlackIsZero、按条带存储的 TIFF 目录
+bool tiffLayout(const TiffReader& tiff, const std::vector<TiffReader::Entry>& entries, qint64 size, RasterLayout& l)
+{
+    quint32 width = 0, height = 0, bits = 1, compression = 1, photometric = 0, spp = 1;
+    quint32 rowsPerStrip = UINT32_MAX;
+    const TiffReader::Entry* offsets = nullptr;
+    for (const auto& e : entries) {
+        switch (e.tag) {
+        case 256: tiff.value(e, 0, width); break;
+        case 257: tiff.value(e, 0, height); break;
+        case 258: tiff.value(e, 0, bits); break;
+        case 259: tiff.value(e, 0, compression); break;
+        case 262: tiff.value(e, 0, photometric); break;
+        case 273: offsets = &e; break;
+        case 277: tiff.value(e, 0, spp); break;
+        case 278: tiff.value(e, 0, rowsPerStrip); break;
+        case 322: case 323: return false; // 分块存储交给解码器
+        default: break;
+        }
+    }
+    if (width == 0 || height == 0 || width > INT32_MAX || height > INT32_MAX) return false;
+    if (compression != 1 || (bits != 8 && bits != 16) || spp != 1 || photometric != 1 || offsets == nullptr) return false;
+
+    l = RasterLayout();
+    l.cols = static_cast<int>(width);
+    l.rows = static_cast<int>(height);
+    if (bits == 16) {
+        l.depth = CV_16U;
+        l.swapBytes = tiff.bigEndian() != kHostBigEndian;
+    }
+    l.step = static_cast<size_t>(width) * l.pixelBytes();
+    l.rowsPerStrip = static_cast<int>(std::min<quint32>(rowsPerStrip == 0 ? height : rowsPerStrip, height));
+
+    const quint32 stripCount = (height + l.rowsPerStrip - 1) / l.rowsPerStrip;
+    if (offsets->count < stripCount) return false;
+    std::vector<qint64> strips(stripCount);
+    bool contiguous = true;
+    for (quint32 i = 0; i < stripCount; ++i) {
+        quint32 off = 0;
+        if (!tiff.value(*offsets, i, off)) return false;
+        strips[i] = off;
+        const quint32 stripRows = std::min<quint32>(l.rowsPerStrip, height - i * l.rowsPerStrip);
+        if (strips[i] + qint64(stripRows) * qint64(l.step) > size) return false;
+        if (i > 0 && strips[i] != strips[i - 1] + qint64(l.rowsPerStrip) * qint64(l.step)) contiguous = false;
+    }
+    // 条带首尾相接时按整幅连续处理，可零拷贝包装
+    l.offset = strips[0];
+    if (!contiguous) l.strips = std::move(strips);
+    return true;
+}
+
+bool tiffLayoutAt(const uchar* data, qint64 size, quint32 ifd, RasterLayout& l)
+{
+    TiffReader tiff(data, size);
+    std::vector<TiffReader::Entry> entries;
+    quint32 next = 0;
+    return tiff.valid() && tiff.readIFD(ifd, entries, next) && tiffLayout(tiff, entries, size, l);
+}
+
+bool probeTIFF(const uchar* data, qint64 size, RasterLayout& l)
+{
+    TiffReader tiff(data, size);
+    return tiff.valid() && tiffLayoutAt(data, size, tiff.firstIFD(), l);
+}
+
+// 沿目录链收集全部页的 IFD 偏移，遇到环或越界即停止
+std::vector<quint32> tiffDirectories(const uchar* data, qint64 size)
+{
+    std::vector<quint32> ifds;
+    TiffReader tiff(data, size);
+    if (!tiff.valid()) return ifds;
+
+    std::set<quint32> visited;
+    std::vector<TiffReader::Entry> entries;
+    quint32 ifd = tiff.firstIFD();
+    while (ifd != 0 && visited.insert(ifd).second) {
+        quint32 next = 0;
+        if (!tiff.readIFD(ifd, entries, next)) break;
+        ifds.push_back(ifd);
+        ifd = next;
+    }
+    return ifds;
+}
+
+constexpr char kRawMagic[8] = {'D', 'I', 'P', 'R', 'A', 'W', '0', '1'};
+constexpr qint64 kRawHeaderSize = 32;
+
+// DIPRAW 容器：l 为第 0 帧布局，frames 为可用帧数
+bool probeDipRaw(const uchar* data, qint64 size, RasterLayout& l, int* frames = nullptr)
+{
+    if (size < kRawHeaderSize || std::memcmp(data, kRawMagic, sizeof(kRawMagic)) != 0) return false;
+    const quint32 width = le32(data + 8);
+    const quint32 height = le32(data + 12);
+    const quint32 bits = le32(data + 16);
+    const quint32 count = le32(data + 20);
+    const quint64 offset = quint64(le32(data + 24)) | (quint64(le32(data + 28)) << 32);
+    if (width == 0 || height == 0 || width > INT32_MAX || height > INT32_MAX || (bits != 8 && bits != 16)) return false;
+    if (offset < quint64(kRawHeaderSize) || offset > quint64(size)) return false;
+
+    l = RasterLayout();
+    l.offset = static_cast<qint64>(offset);
+    l.cols = static_cast<int>(width);
+    l.rows = static_cast<int>(height);
+    if (bits == 16) {
+        l.depth = CV_16U;
+        l.swapBytes = kHostBigEndian;
+    }
+    l.step = static_cast<size_t>(width) * l.pixelBytes();
+
+    // 按文件长度截断，写入中断的尾帧不计入
+    const qint64 frameBytes = qint64(l.step) * l.rows;
+    const qint64 available = (size - l.offset) / frameBytes;
+    const qint64 n = count == 0 ? available : std::min<qint64>(count, available);
+    if (n <= 0 || n > INT32_MAX) return false;
+    if (frames) *frames = static_cast<int>(n);
+    return true;
+}
+
+#ifdef DIP_HAVE_PNG
+struct PngSource {
+    const uchar* data;
+    size_t size;
+    size_t pos;
+};
+
+void pngRead(png_structp png, png_bytep out, png_size_t n)
+{
+    auto* src = static_cast<PngSource*>(png_get_io_ptr(png));
+    if (src->pos + n > src->size) png_error(png, "truncated PNG stream");
+    std::memcpy(out, src->data + src->pos, n);
+    src->pos += n;
+}
+
+// 逐行解码 PNG，读完 ROI 最后一行即停止；灰度转换与 imgcodecs 的 PNG 解码器一致，16 位保留原始位深。
+// 隔行扫描的图必须读完所有 pass，返回 false 交给 imdecode
+bool decodePNGRegion(const MappedFile& file, cv::Rect roi, cv::Mat& out)
+{
+    if (file.size() < 8 || png_sig_cmp(file.data(), 0, 8) != 0) return false;
+    png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+    if (!png) return false;
+    png_infop info = png_create_info_struct(png);
+    if (!info) { png_destroy_read_struct(&png, nullptr, nullptr); return false; }
+
+    PngSource src{file.data(), static_cast<size_t>(file.size()), 0};
+    cv::Mat result;
+    // 行缓冲由解码线程跨帧复用
+    static thread_local std::vector<uchar> row;
+    bool ok = false;
+    if (setjmp(png_jmpbuf(png)) == 0) {
+        png_set_read_fn(png, &src, pngRead);
+        png_read_info(png, info);
+
+        png_uint_32 width = 0, height = 0;
+        int depth = 0, colorType = 0, interlace = 0;
+        png_get_IHDR(png, info, &width, &height, &depth, &colorType, &interlace, nullptr, nullptr);
+        const cv::Rect full(0, 0, static_cast<int>(width), static_cast<int>(height));
+        const cv::Rect r = roi.area() > 0 ? roi : full;
+
+        if (interlace == PNG_INTERLACE_NONE && (r & full) == r) {
+            png_set_strip_alpha(png);
+            if (colorType == PNG_COLOR_TYPE_PALETTE) png_set_palette_to_rgb(png);
+            if ((colorType & PNG_COLOR_MASK_COLOR) == 0 && depth < 8) png_set_expand_gray_1_2_4_to_8(png);
+            if (colorType & PNG_COLOR_MASK_COLOR) png_set_rgb_to_gray(png, 1, 0.299, 0.587);
+            // PNG 的 16 位样本为大端
+            if (depth == 16 && !kHostBigEndian) png_set_swap(png);
+            png_read_update_info(png, info);
+
+            const int outDepth = png_get_bit_depth(png, info);
+            if (png_get_channels(png, info) == 1 && (outDepth == 8 || outDepth == 16)) {
+                const size_t bytes = outDepth / 8;
+                row.resize(png_get_rowbytes(png, info));
+                result.create(r.height, r.width, outDepth == 16 ? CV_16U : CV_8U);
+                for (int y = 0; y < r.y + r.height; ++y) {
+                    png_read_row(png, row.data(), nullptr);
+                    if (y >= r.y) std::memcpy(result.ptr(y - r.y), row.data() + r.x * bytes, r.width * bytes);
+                }
+                ok = true;
+            }
+        }
+    }
+    png_destroy_read_struct(&png, &info, nullptr);
+    if (ok) out = result;
+    return ok;
+}
+#endif
+
+}
+
+std::shared_ptr<MappedFile> MappedFile::open(const QString& path)
+{
+    std::shared_ptr<MappedFile> file(new MappedFile);
+    file->m_file.setFileName(path);
+    if (!file->m_file.open(QIODevice::ReadOnly)) return nullptr;
+
+    const qint64 size = file->m_file.size();
+    if (size <= 0) return nullptr;
+
+    file->m_map = file->m_file.map(0, size);
+    if (file->m_map) {
+        file->m_data = file->m_map;
+    } else {
+        file->m_fallback = file->m_file.readAll();
+        if (file->m_fallback.size() != size) return nullptr;
+        file->m_data = reinterpret_cast<const uchar*>(file->m_fallback.constData());
+    }
+    file->m_size = size;
+    return file;
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_map) m_file.unmap(m_map);
+}
+
+void MappedFile::prefetch(qint64 offset, qint64 length) const
+{
+    if (m_map == nullptr) return; // 退化路径已整体读入
+    offset = std::clamp<qint64>(offset, 0, m_size);
+    const qint64 end = length < 0 ? m_size : std::min(m_size, offset + length);
+    volatile uchar sink = 0;
+    for (qint64 p = offset; p < end; p += kPageSize) sink = sink ^ m_data[p];
+    if (end > offset) sink = sink ^ m_data[end - 1];
+}
+
+bool probeRaster(const uchar* data, qint64 size, RasterLayout& layout)
+{
+    return probeBMP(data, size, layout) || probePGM(data, size, layout)
+        || probeTIFF(data, size, layout) || probeDipRaw(data, size, layout);
+}
+
+// 包装未压缩栅格的 roi 区域；连续存储、单通道、恒等调色板、自上而下时不发生任何拷贝
+static cv::Mat wrapRaster(const uchar* data, const RasterLayout& l, cv::Rect roi)
+{
+    const int type = CV_MAKETYPE(l.depth, l.channels);
+    const size_t colOffset = static_cast<size_t>(roi.x) * l.pixelBytes();
+    cv::Mat view;
+    if (l.contiguous()) {
+        // 自下而上存储时 ROI 的最后一行在文件中最靠前
+        const int fileRow = l.bottomUp ? l.rows - roi.y - roi.height : roi.y;
+        view = cv::Mat(roi.height, roi.width, type,
+                       const_cast<uchar*>(data + l.offset + qint64(fileRow) * qint64(l.step) + colOffset), l.step);
+    } else {
+        view.create(roi.height, roi.width, type);
+        for (int r = 0; r < roi.height; ++r)
+            std::memcpy(view.ptr(r), data + l.rowOffset(roi.y + r) + colOffset, view.cols * view.elemSize());
+    }
+
+    if (l.swapBytes) {
+        // 非本机字节序的 16 位样本：交换每个样本的两个字节
+        cv::Mat swapped(view.size(), CV_16U);
+        const cv::Mat src8(view.rows, view.cols, CV_8UC2, view.data, view.step);
+        cv::Mat dst8(swapped.rows, swapped.cols, CV_8UC2, swapped.data, swapped.step);
+        const int pairs[] = {0, 1, 1, 0};
+        cv::mixChannels(&src8, 1, &dst8, 1, pairs, 2);
+        view = swapped;
+    }
+
+    cv::Mat gray;
+    if (l.channels == 3) cv::cvtColor(view, gray, cv::COLOR_BGR2GRAY);
+    else if (l.channels == 4) cv::cvtColor(view, gray, cv::COLOR_BGRA2GRAY);
+    else if (!l.lut.empty()) cv::LUT(view, l.lut, gray);
+    else gray = view;
+
+    if (l.bottomUp && l.contiguous()) {
+        // 自下而上存储的行序需要一次翻转；已转换出的图原地翻转
+        if (gray.data == view.data) {
+            cv::Mat flipped;
+            cv::flip(gray, flipped, 0);
+            return flipped;
+        }
+        cv::flip(gray, gray, 0);
+    }
+    return gray;
+}
+
+static cv::Rect resolveROI(cv::Rect roi, int rows, int cols)
+{
+    const cv::Rect full(0, 0, cols, rows);
+    if (roi.area() <= 0) return full;
+    return (roi & full) == roi ? roi : cv::Rect();
+}
+
+cv::Mat decode(const MappedFile& file, cv::Rect roi)
+{
+    RasterLayout layout;
+    if (probeRaster(file.data(), file.size(), layout)) {
+        const cv::Rect r = resolveROI(roi, layout.rows, layout.cols);
+        return r.area() > 0 ? wrapRaster(file.data(), layout, r) : cv::Mat();
+    }
+
+#ifdef DIP_HAVE_PNG
+    cv::Mat png;
+    if (decodePNGRegion(file, roi, png)) return png;
+#endif
+
+    // 其余压缩格式：直接从映射区解码后裁切，整幅图随即释放
+    const cv::Mat buffer(1, static_cast<int>(file.size()), CV_8U, const_cast<uchar*>(file.data()));
+    cv::Mat full = cv::imdecode(buffer, kDecodeFlags);
+    if (full.empty() || roi.area() <= 0) return full;
+    const cv::Rect r = resolveROI(roi, full.rows, full.cols);
+    return r.area() > 0 ? full(r).clone() : cv::Mat();
+}
+
+static void prefetchRaster(const MappedFile& file, const RasterLayout& l, cv::Rect roi)
+{
+    const cv::Rect r = resolveROI(roi, l.rows, l.cols);
+    const qint64 span = qint64(r.width) * qint64(l.pixelBytes());
+    for (int y = r.y; y < r.y + r.height; ++y)
+        file.prefetch(l.rowOffset(y) + qint64(r.x) * qint64(l.pixelBytes()), span);
+}
+
+void prefetch(const MappedFile& file, cv::Rect roi)
+{
+    RasterLayout layout;
+    if (roi.area() > 0 && probeRaster(file.data(), file.size(), layout)) prefetchRaster(file, layout, roi);
+    else file.prefetch();
+}
+
+cv::Mat readImage(const QString& path, cv::Rect roi)
+{
+    auto file = MappedFile::open(path);
+    if (!file) return cv::Mat();
+    cv::Mat img = decode(*file, roi);
+    // 映射区随 file 释放，借用的数据必须复制出来
+    if (!img.empty() && file->contains(img.data)) img = img.clone();
+    return img;
+}
+
+QStringList nameFilters()
+{
+    return {"*.bmp", "*.png", "*.jpg", "*.pgm", "*.tif", "*.tiff", "*.dipraw"};
+}
+
+std::shared_ptr<FrameStack> FrameStack::open(const QString& path)
+{
+    auto file = MappedFile::open(path);
+    if (!file) return nullptr;
+
+    std::shared_ptr<FrameStack> stack(new FrameStack);
+    stack->m_file = file;
+    int frames = 0;
+    if (probeDipRaw(file->data(), file->size(), stack->m_raw, &frames)) {
+        stack->m_frameBytes = qint64(stack->m_raw.step) * stack->m_raw.rows;
+        stack->m_count = frames;
+        return stack;
+    }
+    stack->m_ifds = tiffDirectories(file->data(), file->size());
+    if (stack->m_ifds.empty() || stack->m_ifds.size() > size_t(INT32_MAX)) return nullptr;
+    stack->m_count = static_cast<int>(stack->m_ifds.size());
+    return stack;
+}
+
+bool FrameStack::layout(int frame, RasterLayout& l) const
+{
+    if (frame < 0 || frame >= m_count) return false;
+    if (m_frameBytes > 0) {
+        l = m_raw;
+        l.offset += qint64(frame) * m_frameBytes;
+        return true;
+    }
+    return tiffLayoutAt(m_file->data(), m_file->size(), m_ifds[frame], l);
+}
+
+cv::Mat FrameStack::decode(int frame, cv::Rect roi) const
+{
+    if (frame < 0 || frame >= m_count) return cv::Mat();
+    RasterLayout l;
+    if (layout(frame, l)) {
+        const cv::Rect r = resolveROI(roi, l.rows, l.cols);
+        return r.area() > 0 ? wrapRaster(m_file->data(), l, r) : cv::Mat();
+    }
+
+    // 压缩页：只解码目标页
+    const cv::Mat buffer(1, static_cast<int>(m_file->size()), CV_8U, const_cast<uchar*>(m_file->data()));
+    std::vector<cv::Mat> pages;
+    if (!cv::imdecodemulti(buffer, kDecodeFlags, pages, cv::Range(frame, frame + 1)) || pages.empty())
+        return cv::Mat();
+    if (roi.area() <= 0) return pages[0];
+    const cv::Rect r = resolveROI(roi, pages[0].rows, pages[0].cols);
+    return r.area() > 0 ? pages[0](r).clone() : cv::Mat();
+}
+
+void FrameStack::prefetch(int frame, cv::Rect roi) const
+{
+    RasterLayout l;
+    if (layout(frame, l)) prefetchRaster(*m_file, l, roi);
+    else m_file->prefetch();
+}
+
+}
@@ -0,0 +1,132 @@
+#pragma once
+#include <QFile>
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <memory>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+/**
+ * @brief 零拷贝、ROI 感知的图像读取
+ * 文件以内存映射方式打开，解码直接作用于映射区，不再经过 QByteArray / std::vector 两次整帧拷贝。
+ * 解码保留原始位深（8 / 16 位灰度，IMREAD_ANYDEPTH）。
+ * 未压缩格式（BMP、PGM、未压缩 8/16 位灰度 TIFF）直接以 cv::Mat 头包装映射区，完全跳过解码；
+ * 给定 ROI 时只访问 ROI 覆盖的行与列。PNG 逐行解码并在 ROI 最后一行后停止（需 libpng）；
+ * 其余格式交给 cv::imdecode 后裁切。
+ *
+ * 多帧文件（多页 TIFF、DIPRAW 容器）由 FrameStack 按帧索引从同一映射区顺序读取。
+ * DIPRAW 容器为 32 字节小端头加定长帧，帧按行主序紧密排列：
+ *   0  char[8] "DIPRAW01"
+ *   8  u32     宽
+ *  12  u32     高
+ *  16  u32     每像素位数（8 或 16，16 位样本为小端）
+ *  20  u32     帧数（0 表示按文件长度推断）
+ *  24  u64     首帧偏移（>= 32）
+ */
+namespace ImageIO {
+
+/**
+ * @brief 只读内存映射文件
+ * 映射失败（如某些网络文件系统不支持 mmap）时退化为一次 readAll。
+ */
+class MappedFile {
+public:
+    // 打开失败或文件为空时返回 nullptr
+    static std::shared_ptr<MappedFile> open(const QString& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uchar* data() const { return m_data; }
+    qint64 size() const { return m_size; }
+    bool contains(const void* p) const {
+        const uchar* q = static_cast<const uchar*>(p);
+        return q >= m_data && q < m_data + m_size;
+    }
+
+    // 逐页触碰 [offset, offset+length)，在调用线程中完成缺页读盘；length < 0 表示到文件末尾
+    void prefetch(qint64 offset = 0, qint64 length = -1) const;
+
+private:
+    MappedFile() = default;
+
+    QFile m_file;
+    uchar* m_map = nullptr;
+    QByteArray m_fallback;
+    const uchar* m_data = nullptr;
+    qint64 m_size = 0;
+};
+
+/**
+ * @brief 未压缩栅格在文件中的布局
+ * 连续存储时行 r（自上而下）位于 offset + (bottomUp ? rows-1-r : r) * step；
+ * 分条存储（TIFF 条带不相邻）时位于 strips[r / rowsPerStrip] + (r % rowsPerStrip) * step。
+ */
+struct RasterLayout {
+    qint64 offset = 0;
+    int rows = 0;
+    int cols = 0;
+    size_t step = 0;     // 行跨度（字节，含行尾填充）
+    int depth = CV_8U;   // CV_8U / CV_16U
+    int channels = 1;    // 1: 灰度/调色板索引, 3: BGR, 4: BGRX
+    bool swapBytes = false; // 16 位样本与本机字节序相反
+    bool bottomUp = false;
+    cv::Mat lut;         // 调色板转灰度表（1x256 CV_8U），恒等映射时为空
+    std::vector<qint64> strips;
+    int rowsPerStrip = 0;
+
+    bool contiguous() const { return strips.empty(); }
+    size_t pixelBytes() const { return static_cast<size_t>(channels) * CV_ELEM_SIZE1(depth); }
+    qint64 rowOffset(int r) const {
+        if (!strips.empty()) return strips[r / rowsPerStrip] + qint64(r % rowsPerStrip) * qint64(step);
+        return offset + qint64(bottomUp ? rows - 1 - r : r) * qint64(step);
+    }
+};
+
+// 识别可直接包装的未压缩格式（多帧文件取第一帧）；不支持的格式返回 false
+bool probeRaster(const uchar* data, qint64 size, RasterLayout& layout);
+
+// 解码为原始位深的灰度图，roi 为空表示整幅，roi 超出图像范围时返回空 Mat。
+// 可包装时返回的 Mat 直接引用 file 的映射区，调用方需保证 file 存活
+cv::Mat decode(const MappedFile& file, cv::Rect roi = cv::Rect());
+
+// 预读 decode(file, roi) 将访问的页：未压缩格式只触碰 ROI 所在行的列区间，其余格式整个文件
+void prefetch(const MappedFile& file, cv::Rect roi = cv::Rect());
+
+// 读取一幅独立持有数据的灰度图，路径编码由 Qt 处理（包括 Windows 下的中文路径）
+cv::Mat readImage(const QString& path, cv::Rect roi = cv::Rect());
+
+// 批处理可接受的输入文件名过滤器
+QStringList nameFilters();
+
+/**
+ * @brief 多帧文件
+ * 打开时建立一次帧索引（TIFF 的目录偏移表 / DIPRAW 的定长步距），之后按帧随机访问为 O(1)。
+ * 只读，可被多个线程共享。
+ */
+class FrameStack {
+public:
+    // 不是多帧格式或无法解析时返回 nullptr
+    static std::shared_ptr<FrameStack> open(const QString& path);
+
+    int size() const { return m_count; }
+    const std::shared_ptr<MappedFile>& file() const { return m_file; }
+
+    // 同 ImageIO::decode，返回的 Mat 可能引用映射区
+    cv::Mat decode(int frame, cv::Rect roi = cv::Rect()) const;
+    void prefetch(int frame, cv::Rect roi = cv::Rect()) const;
+
+private:
+    FrameStack() = default;
+    bool layout(int frame, RasterLayout& l) const;
+
+    std::shared_ptr<MappedFile> m_file;
+    std::vector<quint32> m_ifds;   // TIFF 各页目录偏移
+    RasterLayout m_raw;            // DIPRAW 第 0 帧布局
+    qint64 m_frameBytes = 0;
+    int m_count = 0;
+};
+
+}
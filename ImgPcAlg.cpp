@@ -1,10 +1,17 @@
 #include "ImgPcAlg.h"
+#include "GradKernel.h"
+#include <limits>
 
 QString MSVNAME = "MSV",
     NIPCNAME = "NIPC",
-    ZNCCNAME = "ZNCC";
+    ZNCCNAME = "ZNCC",
+    ZNCCSHIFTNAME = "ZNCCshift",
+    LOCALZNCCNAME = "localZNCC",
+    LOCALNIPCNAME = "localNIPC";
 
 const int factor = 1;
+const int maxShift = 8;
+const int mapWindow = 15;
 
 PreTreatClass<PreTreatMethod::Classic> globalScheme;
 const double threshold = 0.02;
@@ -16,7 +23,7 @@ void applyThreshold(cv::UMat& m, double ratio)
     cv::threshold(m, m, maxVal * ratio, 0, cv::THRESH_TOZERO);
 }
 
-cv::UMat preTreat(const cv::UMat& src, PreTreatClass<PreTreatMethod::Classic> Scheme = globalScheme)
+cv::UMat preTreat(const cv::UMat& src, PreTreatClass<PreTreatMethod::Classic> Scheme)
 {
     // f(x+1, y+1)
     cv::Rect r1(1, 1, src.cols - 1, src.rows - 1);
@@ -41,64 +48,472 @@ cv::UMat preTreat(const cv::UMat& src, PreTreatClass<PreTreatMethod::Classic> Sc
     return grad;
 }
 
-BaseAlg::BaseAlg(cv::InputArray img, int f) : m_factor(std::max(1, f)) {
-    if (img.empty()) throw std::invalid_argument("Reference image is empty.");
-    img.getUMat().convertTo(m_refImg, CV_32F);
-    cv::UMat tmpImg = preTreat(m_refImg);
-    downsample(tmpImg, m_downRef);
-}
-
-void BaseAlg::downsample(const cv::UMat& src, cv::UMat& dst) const {
-    if (m_factor > 1) {
-        cv::resize(src, dst, cv::Size(src.cols / m_factor, src.rows / m_factor), 0, 0, cv::INTER_AREA);
+void downsampleBy(const cv::UMat& src, cv::UMat& dst, int f)
+{
+    if (f > 1) {
+        cv::resize(src, dst, cv::Size(src.cols / f, src.rows / f), 0, 0, cv::INTER_AREA);
     }
     else {
         src.copyTo(dst);
     }
 }
 
-cv::UMat BaseAlg::prepareInput(cv::InputArray input) const {
-    cv::UMat in = input.getUMat();
-    if (in.size() != m_refImg.size()) throw std::invalid_argument("Input size mismatch.");
-    if (in.type() != CV_32F) in.convertTo(in, CV_32F);
-    return in;
+/*************
+ *FrameContext*
+ *************/
+FrameContext::FrameContext(cv::InputArray input) : m_input(input.getMat()) {}
+
+const cv::UMat& FrameContext::floatImg()
+{
+    if (m_float.empty()) {
+        if (m_input.type() == CV_32F) m_input.copyTo(m_float);
+        else m_input.convertTo(m_float, CV_32F);
+    }
+    return m_float;
+}
+
+// 在原始位深上计算 preTreat：整型 SIMD 求梯度最大值，再一遍写出阈值化后的浮点梯度
+template<typename T>
+static void nativeGradient(const cv::Mat& in, cv::Mat& dst)
+{
+    const T* src = in.ptr<T>();
+    float maxVal = GradKernel::gradientMax(src, in.step, in.rows, in.cols);
+    GradKernel::thresholdedGradient(src, in.step, in.rows, in.cols, static_cast<float>(maxVal * threshold),
+                                    dst.ptr<float>(), dst.step);
+}
+
+static bool hasNativeKernel(const cv::Mat& in)
+{
+    const int type = in.type();
+    return (type == CV_8U || type == CV_16U || type == CV_32F) && in.rows > 1 && in.cols > 1;
+}
+
+const cv::UMat& FrameContext::gradient()
+{
+    if (m_grad.empty()) {
+        if (hasNativeKernel(m_input)) {
+            // 不生成整帧浮点副本与 diff1/diff2 临时图
+            m_grad.create(m_input.rows - 1, m_input.cols - 1, CV_32F);
+            cv::Mat g = m_grad.getMat(cv::ACCESS_WRITE);
+            switch (m_input.depth()) {
+            case CV_8U:  nativeGradient<uint8_t>(m_input, g); break;
+            case CV_16U: nativeGradient<uint16_t>(m_input, g); break;
+            default:     nativeGradient<float>(m_input, g); break;
+            }
+        }
+        else m_grad = preTreat(floatImg());
+    }
+    return m_grad;
+}
+
+static bool isPow2(int f)
+{
+    return f > 1 && (f & (f - 1)) == 0;
+}
+
+FrameContext::Scaled& FrameContext::scaled(int f)
+{
+    f = std::max(1, f);
+    Scaled& s = m_scaled[f];
+    if (s.down.empty()) {
+        // 因子为 1 时直接共享梯度图，避免整帧拷贝
+        if (f == 1) s.down = gradient();
+        else if (isPow2(f)) downsampleBy(scaled(f / 2).down, s.down, 2);
+        else downsampleBy(gradient(), s.down, f);
+    }
+    return s;
+}
+
+const cv::UMat& FrameContext::downGradient(int f)
+{
+    return scaled(f).down;
+}
+
+double FrameContext::downGradientNorm(int f)
+{
+    Scaled& s = scaled(f);
+    if (s.norm < 0) s.norm = cv::norm(s.down, cv::NORM_L2);
+    return s.norm;
+}
+
+void FrameContext::downGradientMeanStd(int f, double& mean, double& stddev)
+{
+    Scaled& s = scaled(f);
+    if (!s.hasMeanStd) {
+        cv::Scalar m, sd;
+        cv::meanStdDev(s.down, m, sd);
+        s.mean = m[0];
+        s.stddev = sd[0];
+        s.hasMeanStd = true;
+    }
+    mean = s.mean;
+    stddev = s.stddev;
+}
+
+const cv::UMat& FrameContext::downImage(int f)
+{
+    if (f <= 1) return floatImg();
+    cv::UMat& d = m_downImg[f];
+    if (d.empty()) {
+        if (isPow2(f)) downsampleBy(downImage(f / 2), d, 2);
+        else downsampleBy(floatImg(), d, f);
+    }
+    return d;
+}
+
+/********
+ *BaseAlg*
+ ********/
+BaseAlg::BaseAlg(cv::InputArray img, int f) : m_factor(std::max(1, f)) {
+    if (img.empty()) throw std::invalid_argument("Reference image is empty.");
+    // 参考图与输入帧走同一条梯度与金字塔路径，保证两侧预处理一致
+    FrameContext ref(img);
+    m_refImg = ref.floatImg();
+    m_downRef = ref.downGradient(m_factor);
+}
+
+BaseAlg::BaseAlg(FrameContext& ref, int f) : m_factor(std::max(1, f)) {
+    if (ref.empty()) throw std::invalid_argument("Reference image is empty.");
+    m_refImg = ref.floatImg();
+    m_downRef = ref.downGradient(m_factor);
+}
+
+double BaseAlg::process(cv::InputArray input) const {
+    ensureInputNotEmpty(input);
+    FrameContext frame(input);
+    return processFrame(frame);
 }
 
 // NIPC: 归一化图像相位相关
 NIPCAlg::NIPCAlg(cv::InputArray img, int f) : BaseAlg(img, f) {
+    prepareRef();
+}
+
+NIPCAlg::NIPCAlg(FrameContext& ref, int f) : BaseAlg(ref, f) {
+    prepareRef();
+}
+
+void NIPCAlg::prepareRef() {
     m_refNorm = cv::norm(m_downRef, cv::NORM_L2);
     if (m_refNorm < 1e-9) throw std::runtime_error("Reference image is invalid (too dark).");
+    m_downRef.copyTo(m_downRefMat);
 }
 
-double NIPCAlg::process(cv::InputArray input) const {
-    ensureInputNotEmpty(input);
-    cv::UMat downInput;
-    cv::UMat img = prepareInput(input);
-    downsample(preTreat(img), downInput);
-    double inNorm = cv::norm(downInput, cv::NORM_L2);
+template<typename T>
+static GradKernel::DotResult fusedDot(const cv::Mat& in, const cv::Mat& ref)
+{
+    const T* src = in.ptr<T>();
+    float maxVal = GradKernel::gradientMax(src, in.step, in.rows, in.cols);
+    return GradKernel::thresholdedDot(src, in.step, in.rows, in.cols, static_cast<float>(maxVal * threshold),
+                                      ref.ptr<float>(), ref.step);
+}
+
+double NIPCAlg::processFrame(FrameContext& frame) const {
+    ensureSizeMatch(frame);
+
+    // 不下采样时总走融合核：梯度、最大值、阈值与点积在两遍扫描内完成。
+    // 不看帧内是否已有梯度缓存，结果只取决于输入，与同帧先跑了哪些算法无关
+    const cv::Mat& in = frame.input();
+    if (m_factor == 1 && hasNativeKernel(in)) {
+        GradKernel::DotResult r;
+        switch (in.depth()) {
+        case CV_8U:  r = fusedDot<uint8_t>(in, m_downRefMat); break;
+        case CV_16U: r = fusedDot<uint16_t>(in, m_downRefMat); break;
+        default:     r = fusedDot<float>(in, m_downRefMat); break;
+        }
+        double inNorm = std::sqrt(r.normSq);
+        if (inNorm < 1e-9) return 0.0;
+        return r.dot / (m_refNorm * inNorm);
+    }
+
+    const cv::UMat& downInput = frame.downGradient(m_factor);
+    double inNorm = frame.downGradientNorm(m_factor);
     if (inNorm < 1e-9) return 0.0;
     return m_downRef.dot(downInput) / (m_refNorm * inNorm);
 }
 
-// ZNCC: 零均值归一化互相关 (优化 GPU 提取分数)
-double ZNCCAlg::process(cv::InputArray input) const {
-    ensureInputNotEmpty(input);
-    cv::UMat downInput;
-    cv::UMat img(prepareInput(input));
-    downsample(preTreat(img), downInput);
+// ZNCC: 零均值归一化互相关
+// 模板与输入等大时 matchTemplate(TM_CCOEFF_NORMED) 只有零位移一个结果，
+// 等价于 (<a,b> - N*ma*mb) / (N*sa*sb)，因此可直接复用帧缓存中的均值/标准差
+ZNCCAlg::ZNCCAlg(cv::InputArray img, int f) : BaseAlg(img, f) {
+    prepareRef();
+}
 
-    cv::UMat result;
-    cv::matchTemplate(downInput, m_downRef, result, cv::TM_CCOEFF_NORMED);
+ZNCCAlg::ZNCCAlg(FrameContext& ref, int f) : BaseAlg(ref, f) {
+    prepareRef();
+}
 
-    // 关键优化：直接使用 minMaxLoc 拿结果，避免显存到内存的碎片拷贝
-    double maxVal;
-    cv::minMaxLoc(result, nullptr, &maxVal);
-    return std::isnan(maxVal) ? 0.0 : maxVal;
+void ZNCCAlg::prepareRef() {
+    cv::Scalar m, sd;
+    cv::meanStdDev(m_downRef, m, sd);
+    m_refMean = m[0];
+    m_refStd = sd[0];
+}
+
+double ZNCCAlg::processFrame(FrameContext& frame) const {
+    ensureSizeMatch(frame);
+    const cv::UMat& downInput = frame.downGradient(m_factor);
+
+    double inMean, inStd;
+    frame.downGradientMeanStd(m_factor, inMean, inStd);
+
+    const double n = static_cast<double>(m_downRef.total());
+    const double denom = n * m_refStd * inStd;
+    if (denom < 1e-12) return 0.0;
+
+    double val = (m_downRef.dot(downInput) - n * m_refMean * inMean) / denom;
+    if (std::isnan(val)) return 0.0;
+    return std::min(1.0, std::max(-1.0, val));
+}
+
+// ZNCCshift: 带位移搜索的 ZNCC
+ZNCCShiftAlg::ZNCCShiftAlg(cv::InputArray img, int shift, int f) : BaseAlg(img, f) {
+    cv::Mat ref;
+    m_downRef.copyTo(ref);
+
+    // 搜索半径受限于模板至少保留 1 个像素
+    m_shift = std::max(0, std::min(shift / m_factor, (std::min(ref.cols, ref.rows) - 1) / 2));
+    m_tplRect = cv::Rect(m_shift, m_shift, ref.cols - 2 * m_shift, ref.rows - 2 * m_shift);
+    m_dftSize = cv::Size(cv::getOptimalDFTSize(ref.cols), cv::getOptimalDFTSize(ref.rows));
+
+    cv::Mat tpl;
+    cv::subtract(ref(m_tplRect), cv::mean(ref(m_tplRect)), tpl);
+    m_tplNorm = cv::norm(tpl, cv::NORM_L2);
+    if (m_tplNorm < 1e-9) throw std::runtime_error("Reference image is invalid (no texture).");
+
+    cv::Mat padded = cv::Mat::zeros(m_dftSize, CV_32F);
+    tpl.copyTo(padded(cv::Rect(0, 0, tpl.cols, tpl.rows)));
+    cv::dft(padded, m_tplSpec, 0, tpl.rows);
+}
+
+// 一维抛物线插值，返回相对中心的亚像素偏移
+static double parabolicPeak(double l, double c, double r)
+{
+    double d = l - 2.0 * c + r;
+    return std::abs(d) > 1e-12 ? 0.5 * (l - r) / d : 0.0;
+}
+
+ZNCCShiftAlg::Match ZNCCShiftAlg::match(FrameContext& frame) const {
+    ensureSizeMatch(frame);
+    cv::Mat in;
+    frame.downGradient(m_factor).copyTo(in);
+    if (in.size() != m_downRef.size()) throw std::invalid_argument("Input size mismatch.");
+
+    // 分子：FFT 互相关 c(p) = sum_q T'(q) I(q + p)，p 落在 [0, 2S] 内时无循环回绕
+    cv::Mat padded = cv::Mat::zeros(m_dftSize, CV_32F);
+    in.copyTo(padded(cv::Rect(0, 0, in.cols, in.rows)));
+    cv::Mat spec, corr;
+    cv::dft(padded, spec, 0, in.rows);
+    cv::mulSpectrums(spec, m_tplSpec, spec, 0, true);
+    cv::dft(spec, corr, cv::DFT_INVERSE | cv::DFT_SCALE | cv::DFT_REAL_OUTPUT);
+
+    // 分母：由积分图得到每个搜索窗口的和与平方和
+    cv::Mat sum, sqsum;
+    cv::integral(in, sum, sqsum, CV_64F, CV_64F);
+
+    const int side = 2 * m_shift + 1;
+    const int tw = m_tplRect.width, th = m_tplRect.height;
+    const double n = static_cast<double>(tw) * th;
+    cv::Mat ncc(side, side, CV_64F);
+    for (int py = 0; py < side; ++py) {
+        const double* s0 = sum.ptr<double>(py);
+        const double* s1 = sum.ptr<double>(py + th);
+        const double* q0 = sqsum.ptr<double>(py);
+        const double* q1 = sqsum.ptr<double>(py + th);
+        const float* c = corr.ptr<float>(py);
+        double* out = ncc.ptr<double>(py);
+        for (int px = 0; px < side; ++px) {
+            double s = s1[px + tw] - s1[px] - s0[px + tw] + s0[px];
+            double ss = q1[px + tw] - q1[px] - q0[px + tw] + q0[px];
+            double denom = m_tplNorm * std::sqrt(std::max(ss - s * s / n, 0.0));
+            out[px] = denom > 1e-12 ? c[px] / denom : 0.0;
+        }
+    }
+
+    double peak;
+    cv::Point loc;
+    cv::minMaxLoc(ncc, nullptr, &peak, nullptr, &loc);
+
+    Match m;
+    m.peak = std::isnan(peak) ? 0.0 : std::min(1.0, std::max(-1.0, peak));
+    double subX = 0.0, subY = 0.0;
+    if (loc.x > 0 && loc.x < side - 1)
+        subX = parabolicPeak(ncc.at<double>(loc.y, loc.x - 1), peak, ncc.at<double>(loc.y, loc.x + 1));
+    if (loc.y > 0 && loc.y < side - 1)
+        subY = parabolicPeak(ncc.at<double>(loc.y - 1, loc.x), peak, ncc.at<double>(loc.y + 1, loc.x));
+    m.dx = (loc.x - m_shift + subX) * m_factor;
+    m.dy = (loc.y - m_shift + subY) * m_factor;
+    return m;
+}
+
+double ZNCCShiftAlg::processWithAux(FrameContext& frame, std::vector<double>& aux) const {
+    Match m = match(frame);
+    aux.assign({ m.dx, m.dy });
+    return m.peak;
 }
 
 // MSV: 平均绝对差
-double MSVAlg::process(cv::InputArray input) const {
-    ensureInputNotEmpty(input);
-    cv::UMat in = prepareInput(input);
-    return cv::norm(m_refImg, in, cv::NORM_L1) / static_cast<double>(m_refImg.total());
+MSVAlg::MSVAlg(cv::InputArray img, int f) : BaseAlg(img, f) {
+    img.getMat().copyTo(m_refNative);
+    if (m_factor > 1) {
+        FrameContext ref(img);
+        m_refDown = ref.downImage(m_factor);
+    }
+}
+
+MSVAlg::MSVAlg(FrameContext& ref, int f) : BaseAlg(ref, f) {
+    ref.input().copyTo(m_refNative);
+    if (m_factor > 1) m_refDown = ref.downImage(m_factor);
+}
+
+double MSVAlg::processFrame(FrameContext& frame) const {
+    ensureSizeMatch(frame);
+    if (m_factor > 1)
+        return cv::norm(m_refDown, frame.downImage(m_factor), cv::NORM_L1) / static_cast<double>(m_refDown.total());
+    // 与参考图同位深时直接在整型上求 L1（OpenCV 以拓宽的整型 SIMD 累加），不做浮点转换
+    const cv::Mat& in = frame.input();
+    if (in.type() == m_refNative.type())
+        return cv::norm(m_refNative, in, cv::NORM_L1) / static_cast<double>(in.total());
+    return cv::norm(m_refImg, frame.floatImg(), cv::NORM_L1) / static_cast<double>(m_refImg.total());
+}
+
+LocalCorrAlg::LocalCorrAlg(cv::InputArray img, Mode mode, int window, int f)
+    : BaseAlg(img, f), m_mode(mode), m_window(window)
+{
+    if (m_window < 3 || m_window % 2 == 0) throw std::invalid_argument("Window size must be odd and >= 3.");
+    m_downRef.copyTo(m_ref);
+    if (m_window > std::min(m_ref.rows, m_ref.cols)) throw std::invalid_argument("Window larger than the reference.");
+
+    // 窗口统计用双精度累加，避免 E[x^2] - E[x]^2 在单精度下的抵消误差
+    const cv::Size ksize(m_window, m_window);
+    cv::Mat sqMean;
+    cv::boxFilter(m_ref, m_refMean, CV_64F, ksize, cv::Point(-1, -1), true, cv::BORDER_REFLECT);
+    cv::boxFilter(m_ref.mul(m_ref), sqMean, CV_64F, ksize, cv::Point(-1, -1), true, cv::BORDER_REFLECT);
+    if (m_mode == Mode::ZNCC) {
+        cv::Mat var = sqMean - m_refMean.mul(m_refMean);
+        cv::max(var, 0.0, var);
+        cv::sqrt(var, m_refScale);
+    } else {
+        cv::sqrt(sqMean, m_refScale);
+    }
+}
+
+cv::Mat LocalCorrAlg::correlationMap(FrameContext& frame) const
+{
+    ensureSizeMatch(frame);
+    cv::Mat in;
+    frame.downGradient(m_factor).copyTo(in);
+    if (in.size() != m_ref.size()) throw std::invalid_argument("Input size mismatch.");
+
+    const cv::Size ksize(m_window, m_window);
+    cv::Mat inMean, inSq, cross;
+    cv::boxFilter(in, inMean, CV_64F, ksize, cv::Point(-1, -1), true, cv::BORDER_REFLECT);
+    cv::boxFilter(in.mul(in), inSq, CV_64F, ksize, cv::Point(-1, -1), true, cv::BORDER_REFLECT);
+    cv::boxFilter(in.mul(m_ref), cross, CV_64F, ksize, cv::Point(-1, -1), true, cv::BORDER_REFLECT);
+
+    constexpr double eps = 1e-12;
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    cv::Mat map(in.size(), CV_32F);
+    for (int y = 0; y < map.rows; ++y) {
+        const double* mi = inMean.ptr<double>(y);
+        const double* qi = inSq.ptr<double>(y);
+        const double* c = cross.ptr<double>(y);
+        const double* mr = m_refMean.ptr<double>(y);
+        const double* sr = m_refScale.ptr<double>(y);
+        float* out = map.ptr<float>(y);
+        for (int x = 0; x < map.cols; ++x) {
+            double num, den;
+            if (m_mode == Mode::ZNCC) {
+                num = c[x] - mi[x] * mr[x];
+                den = std::sqrt(std::max(0.0, qi[x] - mi[x] * mi[x])) * sr[x];
+            } else {
+                num = c[x];
+                den = std::sqrt(std::max(0.0, qi[x])) * sr[x];
+            }
+            out[x] = den > eps ? static_cast<float>(std::min(1.0, std::max(-1.0, num / den))) : nan;
+        }
+    }
+    return map;
+}
+
+double LocalCorrAlg::processWithMap(FrameContext& frame, cv::Mat& map) const
+{
+    map = correlationMap(frame);
+    // NaN 与自身不相等，map == map 即有效像素掩膜
+    const cv::Mat valid = map == map;
+    if (cv::countNonZero(valid) == 0) return 0.0;
+    return cv::mean(map, valid)[0];
+}
+
+double LocalCorrAlg::processFrame(FrameContext& frame) const
+{
+    cv::Mat map;
+    return processWithMap(frame, map);
+}
+
+void registerDefaultAlgs()
+{
+    AlgRegistry<QString>::instance().Register(MSVNAME, [](cv::InputArray img){
+        return std::make_unique<MSVAlg>(img);
+    });
+    AlgRegistry<QString>::instance().Register(NIPCNAME, [](cv::InputArray img){
+        return std::make_unique<NIPCAlg>(img);
+    });
+    AlgRegistry<QString>::instance().Register(ZNCCNAME, [](cv::InputArray img){
+        return std::make_unique<ZNCCAlg>(img);
+    });
+    AlgRegistry<QString>::instance().Register(ZNCCSHIFTNAME, [](cv::InputArray img){
+        return std::make_unique<ZNCCShiftAlg>(img);
+    });
+    AlgRegistry<QString>::instance().Register(LOCALZNCCNAME, [](cv::InputArray img){
+        return std::make_unique<LocalCorrAlg>(img, LocalCorrAlg::Mode::ZNCC);
+    });
+    AlgRegistry<QString>::instance().Register(LOCALNIPCNAME, [](cv::InputArray img){
+        return std::make_unique<LocalCorrAlg>(img, LocalCorrAlg::Mode::NIPC);
+    });
+}
+
+namespace MultiScale {
+    bool supports(const QString& alg)
+    {
+        return alg == MSVNAME || alg == NIPCNAME || alg == ZNCCNAME;
+    }
+
+    QString outputName(const QString& alg, int f)
+    {
+        return alg + "_x" + QString::number(f);
+    }
+
+    QVector<QString> expandOutputNames(const QVector<QString>& algs, const QVector<int>& factors)
+    {
+        QVector<QString> out;
+        for (const QString& name : algs) {
+            if (supports(name) && !factors.isEmpty()) {
+                for (int f : factors) out.emplaceBack(outputName(name, f));
+            } else {
+                out.emplaceBack(name);
+            }
+        }
+        return out;
+    }
+
+    bool parseOutputName(const QString& name, QString& alg, int& f)
+    {
+        const int pos = name.lastIndexOf("_x");
+        if (pos <= 0) return false;
+        bool ok = false;
+        const int value = name.mid(pos + 2).toInt(&ok);
+        if (!ok || value < 1 || !supports(name.left(pos))) return false;
+        alg = name.left(pos);
+        f = value;
+        return true;
+    }
+
+    std::unique_ptr<AlgInterface> create(const QString& alg, FrameContext& ref, int f)
+    {
+        if (alg == MSVNAME) return std::make_unique<MSVAlg>(ref, f);
+        if (alg == NIPCNAME) return std::make_unique<NIPCAlg>(ref, f);
+        if (alg == ZNCCNAME) return std::make_unique<ZNCCAlg>(ref, f);
+        return nullptr;
+    }
 }
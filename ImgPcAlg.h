@@ -1,15 +1,20 @@
 #pragma once
 #include <opencv2/opencv.hpp>
 #include <memory>
+#include <map>
+#include <vector>
 #include <cmath>
 #include <stdexcept>
 #include <QVector>
 #include <QString>
 
 extern QString MSVNAME,NIPCNAME,ZNCCNAME,
-        CORRNAME,HOMONAME;
+        CORRNAME,HOMONAME,ZNCCSHIFTNAME,
+        LOCALZNCCNAME,LOCALNIPCNAME;
 
 extern const int factor;
+extern const int maxShift;
+extern const int mapWindow;
 
 /**
  * @brief 填充策略枚举
@@ -29,6 +34,50 @@ class PreTreatClass {
     PreTreatMethod m = method;
 };
 
+extern PreTreatClass<PreTreatMethod::Classic> globalScheme;
+
+// 预处理：Roberts 型梯度 + 按最大值比例阈值化
+cv::UMat preTreat(const cv::UMat& src, PreTreatClass<PreTreatMethod::Classic> Scheme = globalScheme);
+// 按整数因子做面积下采样，f <= 1 时拷贝
+void downsampleBy(const cv::UMat& src, cv::UMat& dst, int f);
+
+/**
+ * @brief 单帧共享中间量
+ * 同一帧被多个算法消费时，浮点转换、梯度、下采样梯度、范数、均值/标准差
+ * 均按需计算一次并缓存，供后续算法直接复用。仅供单线程内使用。
+ * 2 的幂因子的下采样构成金字塔：每级由上一级做 2x 面积缩小得到，多尺度时各级只算一次。
+ */
+class FrameContext {
+public:
+    explicit FrameContext(cv::InputArray input);
+
+    const cv::Mat& input() const { return m_input; }
+    cv::Size size() const { return m_input.size(); }
+    bool empty() const { return m_input.empty(); }
+
+    const cv::UMat& floatImg();            // CV_32F 输入
+    const cv::UMat& gradient();            // preTreat 后的梯度图（8/16 位与浮点输入直接在原始位深上计算）
+    const cv::UMat& downGradient(int f);   // 按因子 f 下采样后的梯度图
+    double downGradientNorm(int f);        // 下采样梯度的 L2 范数
+    void downGradientMeanStd(int f, double& mean, double& stddev);
+    const cv::UMat& downImage(int f);      // 按因子 f 下采样后的浮点输入
+
+private:
+    struct Scaled {
+        cv::UMat down;
+        double norm = -1.0;
+        bool hasMeanStd = false;
+        double mean = 0, stddev = 0;
+    };
+    Scaled& scaled(int f);
+
+    cv::Mat m_input;
+    cv::UMat m_float;
+    cv::UMat m_grad;
+    std::map<int, Scaled> m_scaled;
+    std::map<int, cv::UMat> m_downImg;
+};
+
 // 接口层：统一处理逻辑
 class AlgInterface {
 public:
@@ -40,6 +89,29 @@ public:
      */
     virtual double process(cv::InputArray input = cv::noArray()) const = 0;
 
+    /**
+     * @brief 基于帧共享中间量执行，多个算法处理同一帧时应优先使用此接口
+     */
+    virtual double processFrame(FrameContext& frame) const { return process(frame.input()); }
+
+    /**
+     * @brief 附加输出（如位移）。输出名为算法名 + 对应后缀，默认没有附加输出
+     */
+    virtual QVector<QString> auxSuffixes() const { return {}; }
+    virtual double processWithAux(FrameContext& frame, std::vector<double>& aux) const {
+        aux.clear();
+        return processFrame(frame);
+    }
+
+    /**
+     * @brief 逐像素结果图（如局部相关图），默认没有
+     */
+    virtual bool hasMap() const { return false; }
+    virtual double processWithMap(FrameContext& frame, cv::Mat& map) const {
+        map.release();
+        return processFrame(frame);
+    }
+
 protected:
     AlgInterface() = default;
 };
@@ -51,17 +123,22 @@ public:
     BaseAlg& operator=(const BaseAlg&) = delete;
     virtual ~BaseAlg() = default;
 
+    double process(cv::InputArray input = cv::noArray()) const override;
+
 protected:
     explicit BaseAlg(cv::InputArray img, int f = factor);
+    // 由参考帧的共享中间量构造：同一参考图的各尺度实例共用一份参考金字塔
+    BaseAlg(FrameContext& ref, int f);
 
-    void downsample(const cv::UMat& src, cv::UMat& dst) const;
-    cv::UMat prepareInput(cv::InputArray input) const;
     // cv::UMat preTreat(const cv::UMat& src, PreTreatClass<PreTreatMethod::Classic> Scheme);
 
     // 检查输入有效性
     void ensureInputNotEmpty(cv::InputArray input) const {
         if (input.empty()) throw std::invalid_argument("Input image is required for this algorithm.");
     }
+    void ensureSizeMatch(const FrameContext& frame) const {
+        if (frame.size() != m_refImg.size()) throw std::invalid_argument("Input size mismatch.");
+    }
 
     int m_factor;
     cv::UMat m_refImg;
@@ -72,21 +149,94 @@ protected:
 class NIPCAlg final : public BaseAlg {
 public:
     NIPCAlg(cv::InputArray img, int f = factor);
-    double process(cv::InputArray input = cv::noArray()) const override;
+    NIPCAlg(FrameContext& ref, int f);
+    double processFrame(FrameContext& frame) const override;
 private:
+    void prepareRef();
+
     double m_refNorm;
+    cv::Mat m_downRefMat; // 参考梯度的 CPU 副本，供融合核直接读取
 };
 
 class ZNCCAlg final : public BaseAlg {
 public:
-    ZNCCAlg(cv::InputArray img, int f = factor) : BaseAlg(img, f) {}
-    double process(cv::InputArray input = cv::noArray()) const override;
+    ZNCCAlg(cv::InputArray img, int f = factor);
+    ZNCCAlg(FrameContext& ref, int f);
+    double processFrame(FrameContext& frame) const override;
+private:
+    void prepareRef();
+
+    double m_refMean, m_refStd;
 };
 
+/**
+ * @brief 位移容忍的 ZNCC
+ * 以参考梯度的中心区域为模板，在 ±shift 的窗口内用 FFT 互相关搜索峰值：
+ * 模板的零均值频谱与能量在构造时预计算，输入各窗口的均值/方差由积分图得到，
+ * 每帧只需一次正变换和一次逆变换。主结果为峰值相关系数，
+ * 附加输出为输入相对参考的亚像素位移 (dx, dy)，单位为原图像素。
+ */
+class ZNCCShiftAlg final : public BaseAlg {
+public:
+    struct Match {
+        double peak = 0.0;
+        double dx = 0.0, dy = 0.0;
+    };
+
+    ZNCCShiftAlg(cv::InputArray img, int shift = maxShift, int f = factor);
+    double processFrame(FrameContext& frame) const override { return match(frame).peak; }
+    double processWithAux(FrameContext& frame, std::vector<double>& aux) const override;
+    QVector<QString> auxSuffixes() const override { return { "_dx", "_dy" }; }
+
+    Match match(FrameContext& frame) const;
+
+private:
+    int m_shift;        // 下采样后的搜索半径
+    cv::Size m_dftSize;
+    cv::Rect m_tplRect; // 模板在参考梯度中的位置
+    cv::Mat m_tplSpec;  // 零均值模板的 CCS 频谱
+    double m_tplNorm;   // sqrt(sum(T'^2))
+};
+
+/**
+ * @brief 平均绝对差；因子大于 1 时比较面积下采样后的浮点图
+ */
 class MSVAlg final : public BaseAlg {
 public:
-    MSVAlg(cv::InputArray img, int f = factor) : BaseAlg(img, f) {}
-    double process(cv::InputArray input = cv::noArray()) const override;
+    MSVAlg(cv::InputArray img, int f = factor);
+    MSVAlg(FrameContext& ref, int f);
+    double processFrame(FrameContext& frame) const override;
+
+private:
+    cv::Mat m_refNative; // 参考图原始位深副本
+    cv::UMat m_refDown;  // 下采样参考图（因子大于 1 时）
+};
+
+/**
+ * @brief 逐像素局部相关图（局部 ZNCC / NIPC）
+ * 在下采样梯度图上以 window x window 滑动窗口计算输入与参考的局部相关：
+ * 窗口均值、平方均值与互乘均值由归一化 boxFilter（行列两遍滑动和）得到，
+ * 每像素代价与窗口大小无关。参考侧的窗口统计在构造时预计算，边界按反射延拓。
+ * 标量结果为相关图有效像素的均值；窗口内方差为零的像素在相关图中为 NaN。
+ */
+class LocalCorrAlg final : public BaseAlg {
+public:
+    enum class Mode { ZNCC, NIPC };
+
+    LocalCorrAlg(cv::InputArray img, Mode mode, int window = mapWindow, int f = factor);
+    double processFrame(FrameContext& frame) const override;
+    bool hasMap() const override { return true; }
+    double processWithMap(FrameContext& frame, cv::Mat& map) const override;
+
+    // CV_32F，尺寸同下采样梯度图
+    cv::Mat correlationMap(FrameContext& frame) const;
+
+private:
+    Mode m_mode;
+    int m_window;
+    cv::Mat m_ref;      // 下采样参考梯度
+    cv::Mat m_refMean;  // 参考窗口均值（CV_64F）
+    cv::Mat m_refScale; // ZNCC：参考窗口标准差；NIPC：参考窗口均方根（CV_64F）
 };
 
 // GLCM 模块：独立命名空间
@@ -94,6 +244,8 @@ namespace GLCM {
     class GLCmat {
     public:
         GLCmat(cv::InputArray img, int levels, int dx, int dy);
+        // 由已归一化的共生矩阵（CV_32F, levels x levels）直接构造
+        GLCmat(cv::Mat glcm, int levels);
         double getCorrelation() const;
         double getHomogeneity() const;
 
@@ -107,22 +259,73 @@ namespace GLCM {
         void computeStatistics();
     };
 
+    // 相位谱并量化到 [0, grayLevels-1] 的 CV_8U 图
+    cv::Mat getPhaseSpecInternal(cv::InputArray src, int grayLevels, PaddingStrategy strategy = PaddingStrategy::ToOptimalDFT);
     std::shared_ptr<GLCmat> getPSGLCM(cv::InputArray img, int levels, int dx, int dy, PaddingStrategy strategy = PaddingStrategy::ToOptimalDFT);
 
+    /**
+     * @brief GLCM 请求：一组偏移 (dx, dy) 与一组灰度级
+     * 默认值与原先硬编码的 getPSGLCM(img, 32, 1, 0) 一致
+     */
+    struct GLCMRequest {
+        std::vector<int> levels{ 32 };
+        std::vector<cv::Point> offsets{ cv::Point(1, 0) };
+        PaddingStrategy strategy = PaddingStrategy::ToOptimalDFT;
+
+        // 0°/45°/90°/135° 四个方向、若干距离的标准方向偏移集合
+        static std::vector<cv::Point> directionalOffsets(const std::vector<int>& distances);
+    };
+
+    /**
+     * @brief 按请求为一帧批量构建 GLCM
+     * 相位谱只计算一次，每个灰度级只量化一次，所有共生矩阵在一次图像遍历中累加
+     */
+    class GLCMSet {
+    public:
+        GLCMSet(cv::InputArray img, const GLCMRequest& req);
+
+        // 指定灰度级下全部偏移的矩阵，顺序同 req.offsets
+        std::vector<std::shared_ptr<GLCmat>> matrices(int levels) const;
+        std::shared_ptr<GLCmat> get(int levels, cv::Point offset) const;
+
+    private:
+        GLCMRequest m_req;
+        std::vector<std::shared_ptr<GLCmat>> m_glcms; // [灰度级序号 * 偏移数 + 偏移序号]
+    };
+
+    // 输出名：单一灰度级时沿用 CORRNAME/HOMONAME，多灰度级时追加 "_L<levels>"
+    QString outputName(const QString& base, int levels, const GLCMRequest& req);
+    QVector<QString> expandOutputNames(const QVector<QString>& algs, const GLCMRequest& req);
+    bool parseOutputName(const QString& name, const GLCMRequest& req, QString& base, int& levels);
+
     class GLCMAlg : public AlgInterface {
     public:
         GLCMAlg(cv::InputArray img, int levels = 8, int dx = 1, int dy = 0, PaddingStrategy strategy = PaddingStrategy::ToOptimalDFT);
-        explicit GLCMAlg(std::shared_ptr<GLCmat> glcmPtr) : m_glcmPtr(glcmPtr) {}
+        explicit GLCMAlg(std::shared_ptr<GLCmat> glcmPtr) : m_glcms{ glcmPtr } {}
+        // 多方向：特征取各矩阵的平均值
+        explicit GLCMAlg(std::vector<std::shared_ptr<GLCmat>> glcms) : m_glcms(std::move(glcms)) {}
 
     protected:
-        std::shared_ptr<GLCmat> m_glcmPtr;
+        template<typename F>
+        double average(F feature) const {
+            double sum = 0.0;
+            int n = 0;
+            for (const auto& g : m_glcms) {
+                if (!g) continue;
+                sum += feature(*g);
+                ++n;
+            }
+            return n ? sum / n : 0.0;
+        }
+
+        std::vector<std::shared_ptr<GLCmat>> m_glcms;
     };
 
     class GLCMcorrAlg final : public GLCMAlg {
     public:
         using GLCMAlg::GLCMAlg;
         double process(cv::InputArray = cv::noArray()) const override {
-            return m_glcmPtr ? m_glcmPtr->getCorrelation() : 0.0;
+            return average([](const GLCmat& g) { return g.getCorrelation(); });
         }
     };
 
@@ -130,11 +333,28 @@ namespace GLCM {
     public:
         using GLCMAlg::GLCMAlg;
         double process(cv::InputArray = cv::noArray()) const override {
-            return m_glcmPtr ? m_glcmPtr->getHomogeneity() : 0.0;
+            return average([](const GLCmat& g) { return g.getHomogeneity(); });
         }
     };
 }
 
+// 注册默认的参考图类算法（MSV / NIPC / ZNCC / ZNCCshift / localZNCC / localNIPC），GUI 与命令行共用
+void registerDefaultAlgs();
+
+/**
+ * @brief 多尺度：同一算法在多个下采样因子上求值，输出名为 "<算法名>_x<因子>"
+ * 仅 MSV / NIPC / ZNCC 支持。每帧的各尺度共享一个金字塔，参考金字塔每会话构建一次。
+ */
+namespace MultiScale {
+    bool supports(const QString& alg);
+    QString outputName(const QString& alg, int f);
+    // 将支持多尺度的算法按 factors 展开，其余算法原样保留
+    QVector<QString> expandOutputNames(const QVector<QString>& algs, const QVector<int>& factors);
+    bool parseOutputName(const QString& name, QString& alg, int& f);
+    // 基于参考帧（其金字塔在各尺度间共享）构建 alg 在因子 f 上的实例
+    std::unique_ptr<AlgInterface> create(const QString& alg, FrameContext& ref, int f);
+}
+
 template<typename T>
 class AlgRegistry
 {
@@ -1,4 +1,6 @@
 #include "ImgPcAlg.h"
+#include <cfloat>
+#include <opencv2/core/ocl.hpp>
 
 QString CORRNAME = "GLCMcorr",
         HOMONAME = "GLCMhomo";
@@ -8,45 +10,162 @@ QString CORRNAME = "GLCMcorr",
 namespace GLCM
 {
 
-    // 内部辅助：计算相位谱
-static cv::Mat getPhaseSpecInternal(cv::InputArray src, int grayLevels, PaddingStrategy strategy)
+    // 每个工作线程复用的相位谱缓冲区：同一会话内帧尺寸一致，只在首帧（或尺寸变化时）分配
+    struct PhaseBuffers {
+        cv::Size srcSize;
+        cv::Mat padded;   // 实数输入，填充区保持为 0
+        cv::Mat packed;   // CCS 压缩格式的半谱
+        cv::Mat re, im;   // 裁切区域内的实部/虚部
+        cv::Mat phase;
+    };
+
+static PhaseBuffers& phaseBuffers()
+{
+    thread_local PhaseBuffers buf;
+    return buf;
+}
+
+// CCS 压缩格式中，第 0 列与（N 为偶数时）第 N/2 列沿行方向按一维 CCS 存放
+static inline void ccsColumn(const cv::Mat& packed, int c, int v, float& re, float& im)
 {
-    cv::Mat fSrc;
-    src.getMat().convertTo(fSrc, CV_32F);
-
-    cv::Mat complexImg;
-    if (strategy == PaddingStrategy::ToOptimalDFT) {
-        // 获取最优尺寸（2, 3, 5 的倍数）
-        int optW = cv::getOptimalDFTSize(fSrc.cols);
-        int optH = cv::getOptimalDFTSize(fSrc.rows);
-
-        cv::Mat padded;
-        // 采用零填充，BORDER_CONSTANT 保证不引入人为的边缘插值
-        cv::copyMakeBorder(fSrc, padded, 0, optH - fSrc.rows, 0, optW - fSrc.cols,
-                           cv::BORDER_CONSTANT, cv::Scalar::all(0));
-        cv::dft(padded, complexImg, cv::DFT_COMPLEX_OUTPUT);
+    const int M = packed.rows;
+    if (v == 0) {
+        re = packed.at<float>(0, c); im = 0.f;
+    } else if ((M & 1) == 0 && v == M / 2) {
+        re = packed.at<float>(M - 1, c); im = 0.f;
+    } else if (v < M / 2 + (M & 1)) {
+        re = packed.at<float>(2 * v - 1, c); im = packed.at<float>(2 * v, c);
     } else {
-        cv::dft(fSrc, complexImg, cv::DFT_COMPLEX_OUTPUT);
+        // 共轭对称：Y(v) = conj(Y(M - v))
+        re = packed.at<float>(2 * (M - v) - 1, c); im = -packed.at<float>(2 * (M - v), c);
     }
+}
 
-    std::vector<cv::Mat> planes;
-    cv::split(complexImg, planes);
+// 从 CCS 半谱展开出 [0, cols) x [0, rows) 区域的实部与虚部，缺失的一半由 Hermitian 对称得到
+static void unpackCCS(const cv::Mat& packed, int rows, int cols, cv::Mat& re, cv::Mat& im)
+{
+    const int M = packed.rows, N = packed.cols;
+    const int lastDirect = (N - 1) / 2;   // 直接存放的列 [1, lastDirect]
+    const int firstMirror = N / 2 + 1;    // 需要镜像的列 [firstMirror, N)
+    const bool hasNyquist = (N & 1) == 0; // N 为偶数时第 N/2 列单独存放
+
+    re.create(rows, cols, CV_32F);
+    im.create(rows, cols, CV_32F);
+
+    for (int v = 0; v < rows; ++v) {
+        float* pr = re.ptr<float>(v);
+        float* pi = im.ptr<float>(v);
+        const float* P = packed.ptr<float>(v);
+        const float* Pm = packed.ptr<float>((M - v) % M);
 
-    cv::Mat phase;
+        ccsColumn(packed, 0, v, pr[0], pi[0]);
+
+        const int directEnd = std::min(cols - 1, lastDirect);
+        for (int u = 1; u <= directEnd; ++u) {
+            pr[u] = P[2 * u - 1];
+            pi[u] = P[2 * u];
+        }
+        if (hasNyquist && N / 2 < cols) ccsColumn(packed, N - 1, v, pr[N / 2], pi[N / 2]);
+        for (int u = firstMirror; u < cols; ++u) {
+            const int um = N - u;
+            pr[u] = Pm[2 * um - 1];
+            pi[u] = -Pm[2 * um];
+        }
+    }
+}
+
+// T-API 路径：完整复数谱在设备上计算，只把裁切区域的相位取回主机。
+// 与 CCS 路径的差异仅在浮点舍入（容差见 Backend::kSpectrumTolerance）
+static cv::Mat getPhaseFloatOcl(const cv::Mat& srcMat, cv::Size dftSize, PhaseBuffers& buf)
+{
+    cv::UMat padded(dftSize, CV_32F, cv::Scalar(0));
+    cv::UMat dstRoi = padded(cv::Rect(0, 0, srcMat.cols, srcMat.rows));
+    srcMat.convertTo(dstRoi, CV_32F);
+
+    cv::UMat spec, phase;
+    cv::dft(padded, spec, cv::DFT_COMPLEX_OUTPUT, srcMat.rows);
+    std::vector<cv::UMat> planes;
+    cv::split(spec(cv::Rect(0, 0, srcMat.cols, srcMat.rows)), planes);
     cv::phase(planes[0], planes[1], phase);
+    phase.copyTo(buf.phase);
+    return buf.phase;
+}
+
+    // 内部辅助：计算相位谱（未量化，已裁切回原始有效区域）
+    // 返回值引用线程缓冲区，在本线程下一次调用前有效
+static cv::Mat getPhaseFloat(cv::InputArray src, PaddingStrategy strategy)
+{
+    cv::Mat srcMat = src.getMat();
+    PhaseBuffers& buf = phaseBuffers();
+
+    // 尺寸过小时 CCS 退化为一维格式，沿用完整复数谱路径
+    if (srcMat.rows < 2 || srcMat.cols < 2) {
+        cv::Mat fSrc, complexImg;
+        srcMat.convertTo(fSrc, CV_32F);
+        cv::dft(fSrc, complexImg, cv::DFT_COMPLEX_OUTPUT);
+        std::vector<cv::Mat> planes;
+        cv::split(complexImg, planes);
+        cv::Mat phase;
+        cv::phase(planes[0], planes[1], phase);
+        return phase;
+    }
 
-    // 【关键改进】在归一化和灰度映射前，先裁切回原始有效区域
-    // 这样可以避免填充区的 0 值参与 minMax 统计，从而导致相位压缩
-    phase = phase(cv::Rect(0, 0, fSrc.cols, fSrc.rows));
+    // 获取最优尺寸（2, 3, 5 的倍数）
+    cv::Size dftSize = srcMat.size();
+    if (strategy == PaddingStrategy::ToOptimalDFT)
+        dftSize = cv::Size(cv::getOptimalDFTSize(srcMat.cols), cv::getOptimalDFTSize(srcMat.rows));
 
-    // 映射到指定的灰度级 [0, levels-1]
-    cv::normalize(phase, phase, 0, grayLevels - 1, cv::NORM_MINMAX);
+    // 后端由调用方的 Backend::Scope 决定（Spectrum 阶段）
+    if (cv::ocl::useOpenCL()) return getPhaseFloatOcl(srcMat, dftSize, buf);
 
+    // 采用零填充：填充区在缓冲区生命周期内始终为 0，尺寸变化时才重新分配
+    if (buf.srcSize != srcMat.size() || buf.padded.size() != dftSize) {
+        buf.srcSize = srcMat.size();
+        buf.padded = cv::Mat::zeros(dftSize, CV_32F);
+    }
+
+    // 直接转换写入填充缓冲区的左上角，省去中间的浮点副本
+    cv::Mat dstRoi = buf.padded(cv::Rect(0, 0, srcMat.cols, srcMat.rows));
+    srcMat.convertTo(dstRoi, CV_32F);
+
+    // 实数输入的正变换只输出 CCS 半谱；填充的全零行通过 nonzeroRows 跳过
+    cv::dft(buf.padded, buf.packed, 0, srcMat.rows);
+
+    // 【关键改进】只在原始有效区域内展开并计算相位，
+    // 避免填充区参与 minMax 统计导致相位压缩，也省去整幅复数谱的 split
+    unpackCCS(buf.packed, srcMat.rows, srcMat.cols, buf.re, buf.im);
+    cv::phase(buf.re, buf.im, buf.phase);
+    return buf.phase;
+}
+
+    // 相位图的 min/max 只统计一次，之后每个灰度级只做一次量化
+    struct PhaseRange {
+        double minV = 0, maxV = 0;
+    };
+
+static PhaseRange phaseRange(const cv::Mat& phase)
+{
+    PhaseRange r;
+    cv::minMaxLoc(phase, &r.minV, &r.maxV);
+    return r;
+}
+
+// 映射到指定的灰度级 [0, levels-1]，与 normalize(NORM_MINMAX) + convertTo(CV_8U) 等价
+static cv::Mat quantizePhase(const cv::Mat& phase, const PhaseRange& r, int grayLevels)
+{
+    double span = r.maxV - r.minV;
+    double scale = (grayLevels - 1) * (span > DBL_EPSILON ? 1.0 / span : 0.0);
     cv::Mat phaseUint;
-    phase.convertTo(phaseUint, CV_8U);
+    phase.convertTo(phaseUint, CV_8U, scale, -r.minV * scale);
     return phaseUint;
 }
 
+cv::Mat getPhaseSpecInternal(cv::InputArray src, int grayLevels, PaddingStrategy strategy)
+{
+    cv::Mat phase = getPhaseFloat(src, strategy);
+    return quantizePhase(phase, phaseRange(phase), grayLevels);
+}
+
     std::shared_ptr<GLCmat> getPSGLCM(cv::InputArray img, int levels, int dx, int dy, PaddingStrategy strategy)
     {
         cv::Mat processed = img.getMat();
@@ -71,29 +190,131 @@ static cv::Mat getPhaseSpecInternal(cv::InputArray src, int grayLevels, PaddingS
         computeStatistics();
     }
 
-    void GLCmat::computeGLCM(const cv::Mat& img, int dx, int dy)
+    GLCmat::GLCmat(cv::Mat glcm, int levels) : m_glcm(glcm), m_levels(levels)
     {
-        m_glcm = cv::Mat::zeros(m_levels, m_levels, CV_32F);
+        CV_Assert(m_glcm.type() == CV_32F && m_glcm.rows == levels && m_glcm.cols == levels);
+        computeStatistics();
+    }
+
+    // 超过该像素数时按行条带并行累加
+    static const int kParallelPixels = 1 << 20;
+    static const int kMinRowsPerStripe = 64;
+
+    // 单个共生矩阵累加任务：量化图 + 偏移
+    struct CoocJob {
+        const cv::Mat* img; // CV_8U，所有任务尺寸一致
+        int levels;
+        int dx, dy;
+    };
+
+    /**
+     * @brief 共生矩阵累加引擎
+     * 一次按行遍历图像，同时为所有 (量化图, 偏移) 任务累加；每个行条带持有私有整型直方图，
+     * 大图按条带并行，最后归约并归一化为 CV_32F 矩阵。
+     */
+static std::vector<cv::Mat> accumulateCooc(const std::vector<CoocJob>& jobs)
+{
+    struct JobInfo {
+        int x0, x1, y0, y1;
+        int bins, lanes;
+        uchar lut[256];
+    };
+
+    const int nJobs = static_cast<int>(jobs.size());
+    std::vector<cv::Mat> result;
+    if (nJobs == 0) return result;
+
+    const int imgRows = jobs[0].img->rows;
+    const int imgCols = jobs[0].img->cols;
 
-        for (int y = 0; y < img.rows; ++y) {
-            int ty = y + dy;
-            if (ty < 0 || ty >= img.rows) continue;
+    std::vector<JobInfo> info(nJobs);
+    int64 work = 0;
+    for (int j = 0; j < nJobs; ++j) {
+        const CoocJob& job = jobs[j];
+        JobInfo& ji = info[j];
+        // 边界外提：只遍历源像素与偏移目标同时落在图内的区域，内层循环不再判断
+        ji.x0 = std::max(0, -job.dx); ji.x1 = std::min(imgCols, imgCols - job.dx);
+        ji.y0 = std::max(0, -job.dy); ji.y1 = std::min(imgRows, imgRows - job.dy);
+        ji.bins = job.levels * job.levels;
+        // 相邻像素落入同一 bin 时，交错的私有子直方图可避免连续自增的写后读依赖
+        ji.lanes = (job.levels <= 64) ? 4 : 1;
+        // 取模查表，去掉内层循环中的除法
+        for (int v = 0; v < 256; ++v) ji.lut[v] = static_cast<uchar>(v % job.levels);
+        if (ji.x0 < ji.x1 && ji.y0 < ji.y1) work += static_cast<int64>(ji.y1 - ji.y0) * (ji.x1 - ji.x0);
+    }
+
+    int nStripes = 1;
+    if (work >= kParallelPixels)
+        nStripes = std::max(1, std::min(cv::getNumThreads(), imgRows / kMinRowsPerStripe));
+
+    // partial[stripe][job]：条带间无共享写
+    std::vector<std::vector<std::vector<uint32_t>>> partial(nStripes, std::vector<std::vector<uint32_t>>(nJobs));
 
-            const uchar* pSrc = img.ptr<uchar>(y);
-            const uchar* pTar = img.ptr<uchar>(ty);
+    auto body = [&](const cv::Range& range) {
+        for (int s = range.start; s < range.end; ++s) {
+            for (int j = 0; j < nJobs; ++j)
+                partial[s][j].assign(static_cast<size_t>(info[j].bins) * info[j].lanes, 0u);
 
-            for (int x = 0; x < img.cols; ++x) {
-                int tx = x + dx;
-                if (tx < 0 || tx >= img.cols) continue;
+            const int ys = static_cast<int>(static_cast<int64>(imgRows) * s / nStripes);
+            const int ye = static_cast<int>(static_cast<int64>(imgRows) * (s + 1) / nStripes);
+            // 行在外层、任务在内层：同一源行对所有偏移与灰度级只从内存读入一次
+            for (int y = ys; y < ye; ++y) {
+                for (int j = 0; j < nJobs; ++j) {
+                    const JobInfo& ji = info[j];
+                    if (y < ji.y0 || y >= ji.y1 || ji.x0 >= ji.x1) continue;
 
-                int i = pSrc[x] % m_levels;
-                int j = pTar[tx] % m_levels;
-                m_glcm.at<float>(i, j)++;
+                    const CoocJob& job = jobs[j];
+                    const int L = job.levels;
+                    const uchar* lut = ji.lut;
+                    uint32_t* h0 = partial[s][j].data();
+                    uint32_t* h1 = h0 + (ji.lanes > 1 ? ji.bins : 0);
+                    uint32_t* h2 = h0 + (ji.lanes > 1 ? 2 * ji.bins : 0);
+                    uint32_t* h3 = h0 + (ji.lanes > 1 ? 3 * ji.bins : 0);
+
+                    const uchar* pSrc = job.img->ptr<uchar>(y);
+                    const uchar* pTar = job.img->ptr<uchar>(y + job.dy) + job.dx;
+
+                    int x = ji.x0;
+                    for (; x + 4 <= ji.x1; x += 4) {
+                        h0[lut[pSrc[x]] * L + lut[pTar[x]]]++;
+                        h1[lut[pSrc[x + 1]] * L + lut[pTar[x + 1]]]++;
+                        h2[lut[pSrc[x + 2]] * L + lut[pTar[x + 2]]]++;
+                        h3[lut[pSrc[x + 3]] * L + lut[pTar[x + 3]]]++;
+                    }
+                    for (; x < ji.x1; ++x) h0[lut[pSrc[x]] * L + lut[pTar[x]]]++;
+                }
             }
         }
+    };
+
+    if (nStripes > 1) cv::parallel_for_(cv::Range(0, nStripes), body);
+    else body(cv::Range(0, 1));
 
-        double sumVal = cv::sum(m_glcm)[0];
-        if (sumVal > 1e-9) m_glcm /= sumVal;
+    // 归约各条带与各子直方图
+    result.reserve(nJobs);
+    for (int j = 0; j < nJobs; ++j) {
+        const JobInfo& ji = info[j];
+        cv::Mat glcm = cv::Mat::zeros(jobs[j].levels, jobs[j].levels, CV_32F);
+        if (ji.x0 < ji.x1 && ji.y0 < ji.y1) {
+            std::vector<uint64_t> counts(ji.bins, 0u);
+            for (int s = 0; s < nStripes; ++s)
+                for (int l = 0; l < ji.lanes; ++l) {
+                    const uint32_t* h = partial[s][j].data() + static_cast<size_t>(l) * ji.bins;
+                    for (int b = 0; b < ji.bins; ++b) counts[b] += h[b];
+                }
+
+            const double total = static_cast<double>(ji.y1 - ji.y0) * (ji.x1 - ji.x0);
+            float* g = glcm.ptr<float>();
+            for (int b = 0; b < ji.bins; ++b) g[b] = static_cast<float>(counts[b] / total);
+        }
+        result.push_back(glcm);
+    }
+    return result;
+}
+
+    void GLCmat::computeGLCM(const cv::Mat& img, int dx, int dy)
+    {
+        m_glcm = accumulateCooc({ CoocJob{ &img, m_levels, dx, dy } })[0];
     }
 
     void GLCmat::computeStatistics()
@@ -147,6 +368,110 @@ static cv::Mat getPhaseSpecInternal(cv::InputArray src, int grayLevels, PaddingS
 
     GLCMAlg::GLCMAlg(cv::InputArray img, int levels, int dx, int dy, PaddingStrategy strategy)
     {
-        m_glcmPtr = getPSGLCM(img, levels, dx, dy, strategy);
+        m_glcms.push_back(getPSGLCM(img, levels, dx, dy, strategy));
+    }
+
+    /*************
+     *GLCMRequest*
+     *************/
+    std::vector<cv::Point> GLCMRequest::directionalOffsets(const std::vector<int>& distances)
+    {
+        // 图像坐标 y 轴向下：0°、45°、90°、135°
+        std::vector<cv::Point> offsets;
+        for (int d : distances) {
+            offsets.emplace_back(d, 0);
+            offsets.emplace_back(d, -d);
+            offsets.emplace_back(0, -d);
+            offsets.emplace_back(-d, -d);
+        }
+        return offsets;
+    }
+
+    /*********
+     *GLCMSet*
+     *********/
+    GLCMSet::GLCMSet(cv::InputArray img, const GLCMRequest& req) : m_req(req)
+    {
+        if (m_req.levels.empty() || m_req.offsets.empty()) return;
+
+        // 相位谱只计算一次
+        cv::Mat phase = getPhaseFloat(img, m_req.strategy);
+        PhaseRange range = phaseRange(phase);
+
+        // 每个灰度级只量化一次
+        std::vector<cv::Mat> quantized;
+        quantized.reserve(m_req.levels.size());
+        for (int levels : m_req.levels) quantized.push_back(quantizePhase(phase, range, levels));
+
+        // 所有 (灰度级, 偏移) 在一次遍历中累加
+        std::vector<CoocJob> jobs;
+        for (size_t l = 0; l < m_req.levels.size(); ++l)
+            for (const cv::Point& off : m_req.offsets)
+                jobs.push_back(CoocJob{ &quantized[l], m_req.levels[l], off.x, off.y });
+
+        for (cv::Mat& glcm : accumulateCooc(jobs)) {
+            int levels = glcm.rows;
+            m_glcms.push_back(std::make_shared<GLCmat>(glcm, levels));
+        }
+    }
+
+    std::vector<std::shared_ptr<GLCmat>> GLCMSet::matrices(int levels) const
+    {
+        std::vector<std::shared_ptr<GLCmat>> out;
+        const size_t nOff = m_req.offsets.size();
+        for (size_t l = 0; l < m_req.levels.size(); ++l) {
+            if (m_req.levels[l] != levels) continue;
+            for (size_t o = 0; o < nOff && l * nOff + o < m_glcms.size(); ++o)
+                out.push_back(m_glcms[l * nOff + o]);
+            break;
+        }
+        return out;
+    }
+
+    std::shared_ptr<GLCmat> GLCMSet::get(int levels, cv::Point offset) const
+    {
+        const size_t nOff = m_req.offsets.size();
+        for (size_t l = 0; l < m_req.levels.size(); ++l) {
+            if (m_req.levels[l] != levels) continue;
+            for (size_t o = 0; o < nOff; ++o)
+                if (m_req.offsets[o] == offset && l * nOff + o < m_glcms.size()) return m_glcms[l * nOff + o];
+        }
+        return nullptr;
+    }
+
+    /**********
+     *输出名映射*
+     **********/
+    QString outputName(const QString& base, int levels, const GLCMRequest& req)
+    {
+        return req.levels.size() > 1 ? base + "_L" + QString::number(levels) : base;
+    }
+
+    QVector<QString> expandOutputNames(const QVector<QString>& algs, const GLCMRequest& req)
+    {
+        QVector<QString> out;
+        for (const QString& name : algs) {
+            if (name == CORRNAME || name == HOMONAME) {
+                for (int levels : req.levels) out.emplaceBack(outputName(name, levels, req));
+            } else {
+                out.emplaceBack(name);
+            }
+        }
+        return out;
+    }
+
+    bool parseOutputName(const QString& name, const GLCMRequest& req, QString& base, int& levels)
+    {
+        for (const QString& b : { CORRNAME, HOMONAME }) {
+            if (!name.startsWith(b)) continue;
+            for (int l : req.levels) {
+                if (name == outputName(b, l, req)) {
+                    base = b;
+                    levels = l;
+                    return true;
+                }
+            }
+        }
+        return false;
     }
 }
@@ -0,0 +1,232 @@
+#include "backend.h"
+#include "ImgPcAlg.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QStringList>
+#include <opencv2/core/ocl.hpp>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <tuple>
+#include <vector>
+
+namespace Backend {
+
+namespace {
+
+constexpr int kAuto = -1;
+
+// 配置值：kAuto 或 Kind；测定值：-1 表示尚未测定
+std::atomic<int> g_config[kStageCount] = { kAuto, kAuto };
+std::atomic<int> g_tuned[kStageCount] = { -1, -1 };
+
+QMutex g_tuneMutex;
+// 帧形状 (行, 列, 类型) → 各阶段的测定结果
+std::map<std::tuple<int, int, int>, std::array<int, kStageCount>> g_tuneCache;
+
+// 本线程临时开启或关闭 T-API
+struct ThreadOpenCL {
+    bool previous;
+    explicit ThreadOpenCL(bool on) : previous(cv::ocl::useOpenCL()) { cv::ocl::setUseOpenCL(on); }
+    ~ThreadOpenCL() { cv::ocl::setUseOpenCL(previous); }
+};
+
+struct Trial {
+    bool ok = false;
+    double ns = std::numeric_limits<double>::infinity();
+    std::vector<double> values;
+};
+
+// 首次运行为预热（OpenCL 内核编译、缓冲池填充），不计时；至少 3 次，最多约 50 ms
+template<typename F>
+double timePerRun(F&& run)
+{
+    run();
+    QElapsedTimer timer;
+    timer.start();
+    int reps = 0;
+    do {
+        run();
+        ++reps;
+    } while (reps < 3 || (timer.elapsed() < 50 && reps < 50));
+    return double(timer.nsecsElapsed()) / reps;
+}
+
+Trial correlationTrial(const cv::Mat& ref, const cv::Mat& frame, bool opencl)
+{
+    Trial t;
+    ThreadOpenCL mode(opencl);
+    try {
+        // 参考数据在同一后端下构建，与会话中 prepareAlgs 的行为一致
+        NIPCAlg nipc(ref);
+        ZNCCAlg zncc(ref);
+        double a = 0, b = 0;
+        t.ns = timePerRun([&]() {
+            FrameContext ctx(frame);
+            a = nipc.processFrame(ctx);
+            b = zncc.processFrame(ctx);
+        });
+        t.values = { a, b };
+        t.ok = true;
+    }
+    catch (const std::exception& e) {
+        qDebug() << "BackendTrial:" << name(Stage::Correlation) << (opencl ? "opencl" : "cpu") << e.what();
+    }
+    return t;
+}
+
+Trial spectrumTrial(const cv::Mat& frame, bool opencl)
+{
+    Trial t;
+    ThreadOpenCL mode(opencl);
+    try {
+        const GLCM::GLCMRequest req;
+        double corr = 0;
+        t.ns = timePerRun([&]() {
+            GLCM::GLCMSet set(frame, req);
+            const auto glcm = set.get(req.levels.front(), req.offsets.front());
+            corr = glcm ? glcm->getCorrelation() : 0.0;
+        });
+        t.values = { corr };
+        t.ok = true;
+    }
+    catch (const std::exception& e) {
+        qDebug() << "BackendTrial:" << name(Stage::Spectrum) << (opencl ? "opencl" : "cpu") << e.what();
+    }
+    return t;
+}
+
+// OpenCL 更快且结果在容差内时选 OpenCL
+int choose(Stage stage, const Trial& cpu, const Trial& ocl, double tolerance)
+{
+    bool consistent = cpu.ok && ocl.ok && cpu.values.size() == ocl.values.size();
+    for (size_t i = 0; consistent && i < cpu.values.size(); ++i)
+        consistent = std::abs(cpu.values[i] - ocl.values[i]) <= tolerance;
+    const Kind kind = consistent && ocl.ns < cpu.ns ? Kind::OpenCL : Kind::Cpu;
+    qDebug() << "Backend" << name(stage) << "cpu:" << cpu.ns / 1e6 << "ms opencl:" << ocl.ns / 1e6 << "ms"
+             << (consistent ? "" : "(inconsistent)") << "->" << name(kind);
+    return static_cast<int>(kind);
+}
+
+bool parseKind(const QString& text, int& kind)
+{
+    if (text == "auto") kind = kAuto;
+    else if (text == "cpu") kind = static_cast<int>(Kind::Cpu);
+    else if (text == "opencl" || text == "ocl") kind = static_cast<int>(Kind::OpenCL);
+    else return false;
+    return true;
+}
+
+}
+
+bool openclAvailable()
+{
+    return cv::ocl::haveOpenCL();
+}
+
+QString name(Kind kind)
+{
+    return kind == Kind::OpenCL ? "opencl" : "cpu";
+}
+
+QString name(Stage stage)
+{
+    return stage == Stage::Spectrum ? "spectrum" : "correlation";
+}
+
+bool configure(const QString& spec)
+{
+    const QString text = spec.trimmed().toLower();
+    int kind = kAuto;
+    if (parseKind(text, kind)) {
+        for (auto& c : g_config) c = kind;
+        return true;
+    }
+
+    std::array<int, kStageCount> values;
+    for (int s = 0; s < kStageCount; ++s) values[s] = g_config[s];
+    for (const QString& part : text.split(',', Qt::SkipEmptyParts)) {
+        const QStringList kv = part.split('=');
+        if (kv.size() != 2 || !parseKind(kv[1].trimmed(), kind)) return false;
+        int stage = -1;
+        for (int s = 0; s < kStageCount; ++s) {
+            if (kv[0].trimmed() == name(static_cast<Stage>(s))) stage = s;
+        }
+        if (stage < 0) return false;
+        values[stage] = kind;
+    }
+    for (int s = 0; s < kStageCount; ++s) g_config[s] = values[s];
+    return true;
+}
+
+void set(Stage stage, Kind kind)
+{
+    g_config[static_cast<int>(stage)] = static_cast<int>(kind);
+}
+
+Kind get(Stage stage)
+{
+    const int s = static_cast<int>(stage);
+    const int configured = g_config[s];
+    if (configured != kAuto) return static_cast<Kind>(configured);
+    const int tuned = g_tuned[s];
+    if (tuned >= 0) return static_cast<Kind>(tuned);
+    return openclAvailable() ? Kind::OpenCL : Kind::Cpu;
+}
+
+void autotune(const cv::Mat& sample)
+{
+    if (sample.empty()) return;
+    // 没有 OpenCL 时无需计时，auto 直接落到 CPU
+    if (!openclAvailable()) {
+        for (auto& t : g_tuned) t = static_cast<int>(Kind::Cpu);
+        return;
+    }
+
+    bool anyAuto = false;
+    for (const auto& c : g_config) anyAuto = anyAuto || c == kAuto;
+    if (!anyAuto) return;
+
+    QMutexLocker locker(&g_tuneMutex);
+    const auto shape = std::make_tuple(sample.rows, sample.cols, sample.type());
+    auto cached = g_tuneCache.find(shape);
+    if (cached == g_tuneCache.end()) {
+        // 以水平翻转的参考图作为输入帧，相关值不退化为 1
+        cv::Mat frame;
+        cv::flip(sample, frame, 1);
+
+        std::array<int, kStageCount> result;
+        result[static_cast<int>(Stage::Correlation)] =
+            choose(Stage::Correlation, correlationTrial(sample, frame, false), correlationTrial(sample, frame, true),
+                   kCorrelationTolerance);
+        result[static_cast<int>(Stage::Spectrum)] =
+            choose(Stage::Spectrum, spectrumTrial(frame, false), spectrumTrial(frame, true), kSpectrumTolerance);
+        cached = g_tuneCache.emplace(shape, result).first;
+    }
+    for (int s = 0; s < kStageCount; ++s) g_tuned[s] = cached->second[s];
+}
+
+QString summary()
+{
+    QStringList parts;
+    for (int s = 0; s < kStageCount; ++s) {
+        const Stage stage = static_cast<Stage>(s);
+        parts << name(stage) + "=" + name(get(stage));
+    }
+    return parts.join(' ');
+}
+
+Scope::Scope(Stage stage) : m_previous(cv::ocl::useOpenCL())
+{
+    cv::ocl::setUseOpenCL(get(stage) == Kind::OpenCL);
+}
+
+Scope::~Scope()
+{
+    cv::ocl::setUseOpenCL(m_previous);
+}
+
+}
@@ -0,0 +1,56 @@
+#ifndef BACKEND_H
+#define BACKEND_H
+
+#include <QString>
+#include <opencv2/core.hpp>
+
+/**
+ * @brief 计算后端选择：纯 CPU 或 OpenCL（T-API），按阶段分别设置
+ * 两个阶段：
+ *   Correlation  帧预处理（梯度、金字塔、统计量）与 MSV / NIPC / ZNCC 系列算法
+ *   Spectrum     GLCM 的相位谱
+ * 后端作用于当前线程：Scope 在其生命周期内开启或关闭本线程的 T-API。CPU 后端下 UMat
+ * 只是主机内存的包装，OpenCV 直接调用 CPU 实现，不发生主机与设备之间的隐式往返。
+ *
+ * 设为 auto 的阶段由 autotune() 以实际帧尺寸对两条路径计时后选择较快者；
+ * 两条路径的结果差异超出容差时固定为 CPU。
+ */
+namespace Backend {
+
+enum class Kind { Cpu, OpenCL };
+enum class Stage { Correlation, Spectrum };
+constexpr int kStageCount = 2;
+
+// 两条路径结果的容差（绝对误差），超出时 autotune 不选 OpenCL
+constexpr double kCorrelationTolerance = 1e-5; // NIPC / ZNCC
+constexpr double kSpectrumTolerance = 1e-3;    // GLCM 相关性（相位在 ±π 处的舍入会改变少数像素的量化级）
+
+bool openclAvailable();
+QString name(Kind kind);
+QString name(Stage stage);
+
+// "auto" / "cpu" / "opencl"，或逐阶段如 "correlation=cpu,spectrum=auto"；格式错误时返回 false
+bool configure(const QString& spec);
+void set(Stage stage, Kind kind);
+// auto 且尚未测定的阶段：OpenCL 可用时为 OpenCL（与 OpenCV 默认行为一致），否则为 CPU
+Kind get(Stage stage);
+
+// 对 auto 的阶段以 sample 的尺寸与类型计时，同一尺寸与类型只测一次
+void autotune(const cv::Mat& sample);
+// 形如 "correlation=cpu spectrum=opencl"
+QString summary();
+
+class Scope {
+public:
+    explicit Scope(Stage stage);
+    ~Scope();
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+private:
+    bool m_previous;
+};
+
+}
+
+#endif // BACKEND_H
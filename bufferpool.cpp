@@ -0,0 +1,191 @@
+#include "bufferpool.h"
+#include <QMutex>
+#include <opencv2/core.hpp>
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace BufferPool {
+
+namespace {
+
+// 小块分配交给 fastMalloc，系统分配器自带的线程缓存已经足够
+constexpr size_t kMinPooled = 4096;
+
+std::atomic<quint64> g_requests{0};
+std::atomic<quint64> g_allocations{0};
+std::atomic<quint64> g_bytes{0};
+std::atomic<size_t> g_arenaLimit{size_t(256) << 20};
+std::atomic<bool> g_installed{false};
+
+struct Arena {
+    QMutex mutex;
+    std::unordered_map<size_t, std::vector<void*>> free;
+    size_t cached = 0;
+    bool attached = false; // 由 g_registryMutex 保护
+
+    void* take(size_t size) {
+        QMutexLocker locker(&mutex);
+        auto it = free.find(size);
+        if (it == free.end() || it->second.empty()) return nullptr;
+        void* p = it->second.back();
+        it->second.pop_back();
+        cached -= size;
+        return p;
+    }
+
+    bool give(void* p, size_t size) {
+        QMutexLocker locker(&mutex);
+        if (cached + size > g_arenaLimit.load()) return false;
+        free[size].push_back(p);
+        cached += size;
+        return true;
+    }
+
+    void clear() {
+        QMutexLocker locker(&mutex);
+        for (auto& bucket : free) {
+            for (void* p : bucket.second) cv::fastFree(p);
+        }
+        free.clear();
+        cached = 0;
+    }
+};
+
+// 分区与注册表永不析构：进程退出时仍可能有静态 Mat 归还缓冲
+QBasicMutex g_registryMutex;
+std::vector<Arena*>& registry()
+{
+    static auto* arenas = new std::vector<Arena*>;
+    return *arenas;
+}
+
+// 线程退出时交还分区，缓存的缓冲随分区留给下一个线程
+struct ArenaHandle {
+    Arena* arena = nullptr;
+    ~ArenaHandle() {
+        if (!arena) return;
+        QMutexLocker locker(&g_registryMutex);
+        arena->attached = false;
+    }
+};
+thread_local ArenaHandle t_handle;
+
+Arena* currentArena()
+{
+    if (!t_handle.arena) {
+        QMutexLocker locker(&g_registryMutex);
+        for (Arena* a : registry()) {
+            if (!a->attached) { t_handle.arena = a; break; }
+        }
+        if (!t_handle.arena) {
+            registry().push_back(new Arena);
+            t_handle.arena = registry().back();
+        }
+        t_handle.arena->attached = true;
+    }
+    return t_handle.arena;
+}
+
+/**
+ * 布局与 OpenCV 的 StdMatAllocator 一致，只是数据区取自分区；
+ * 分区指针记在 UMatData::userdata 中，释放时据此归还
+ */
+class PooledAllocator final : public cv::MatAllocator {
+public:
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data0, size_t* step,
+                           cv::AccessFlag, cv::UMatUsageFlags) const override
+    {
+        size_t total = CV_ELEM_SIZE(type);
+        for (int i = dims - 1; i >= 0; --i) {
+            if (step) {
+                if (data0 && step[i] != CV_AUTOSTEP) {
+                    CV_Assert(total <= step[i]);
+                    total = step[i];
+                } else {
+                    step[i] = total;
+                }
+            }
+            total *= sizes[i];
+        }
+
+        cv::UMatData* u = new cv::UMatData(this);
+        u->size = total;
+        if (data0) {
+            u->data = u->origdata = static_cast<uchar*>(data0);
+            u->flags |= cv::UMatData::USER_ALLOCATED;
+            return u;
+        }
+
+        ++g_requests;
+        uchar* p = nullptr;
+        if (total >= kMinPooled) {
+            Arena* arena = currentArena();
+            p = static_cast<uchar*>(arena->take(total));
+            u->userdata = arena;
+        }
+        if (!p) {
+            p = static_cast<uchar*>(cv::fastMalloc(total));
+            ++g_allocations;
+            g_bytes += total;
+        }
+        u->data = u->origdata = p;
+        return u;
+    }
+
+    bool allocate(cv::UMatData* u, cv::AccessFlag, cv::UMatUsageFlags) const override
+    {
+        return u != nullptr;
+    }
+
+    void deallocate(cv::UMatData* u) const override
+    {
+        if (!u) return;
+        CV_Assert(u->urefcount == 0);
+        CV_Assert(u->refcount == 0);
+        if (!(u->flags & cv::UMatData::USER_ALLOCATED)) {
+            auto* arena = static_cast<Arena*>(u->userdata);
+            if (!arena || !arena->give(u->origdata, u->size)) cv::fastFree(u->origdata);
+            u->origdata = nullptr;
+        }
+        u->userdata = nullptr;
+        delete u;
+    }
+};
+
+}
+
+void install()
+{
+    static auto* allocator = new PooledAllocator;
+    cv::Mat::setDefaultAllocator(allocator);
+    g_installed = true;
+}
+
+bool installed()
+{
+    return g_installed.load();
+}
+
+void setArenaLimit(size_t bytes)
+{
+    g_arenaLimit = bytes;
+}
+
+void trim()
+{
+    QMutexLocker locker(&g_registryMutex);
+    for (Arena* a : registry()) a->clear();
+}
+
+Stats stats()
+{
+    Stats s;
+    s.requests = g_requests.load();
+    s.allocations = g_allocations.load();
+    s.bytesAllocated = g_bytes.load();
+    return s;
+}
+
+}
@@ -0,0 +1,35 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <QtGlobal>
+#include <cstddef>
+
+/**
+ * @brief 按线程分区的缓冲池
+ * 安装为 cv::Mat 的默认分配器（未启用 OpenCL 时 UMat 的主机内存同样经由它），
+ * 每个线程一个分区，释放的缓冲按字节数留在分区中：同一会话中逐帧尺寸不变的中间图
+ * （ROI 拷贝、浮点转换、梯度、下采样、频谱等）从第二帧起直接复用，不再经过系统分配器，
+ * 也不再为新映射的大块内存缺页。在其他线程释放的缓冲归还给分配它的分区；
+ * 线程退出后其分区由之后创建的线程接手。
+ */
+namespace BufferPool {
+
+struct Stats {
+    quint64 requests = 0;       // 分配请求数（不含包装外部数据的 Mat）
+    quint64 allocations = 0;    // 其中向系统申请的次数
+    quint64 bytesAllocated = 0; // 向系统申请的总字节数
+};
+
+// 安装为默认分配器，程序启动时调用一次
+void install();
+bool installed();
+// 每个分区缓存的字节上限，超出后释放的缓冲直接归还系统
+void setArenaLimit(size_t bytes);
+// 释放所有分区缓存的缓冲（会话结束后调用，空闲时不占内存）
+void trim();
+
+Stats stats();
+
+}
+
+#endif // BUFFERPOOL_H
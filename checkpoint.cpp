@@ -0,0 +1,81 @@
+#include "checkpoint.h"
+#include <QFile>
+#include <QSaveFile>
+#include <QtEndian>
+#include <cstring>
+
+namespace {
+
+constexpr char kMagic[8] = {'D', 'I', 'P', 'C', 'K', 'P', '0', '1'};
+constexpr int kFingerprintSize = 32;
+constexpr qint64 kHeaderSize = 24 + kFingerprintSize;
+
+template<typename T>
+void appendLE(QByteArray& out, T v)
+{
+    const T le = qToLittleEndian(v);
+    out.append(reinterpret_cast<const char*>(&le), sizeof(T));
+}
+
+}
+
+void SessionManifest::reset(int outputs, qint64 frames, const QByteArray& fingerprint)
+{
+    m_outputs = outputs;
+    m_frames = frames;
+    m_fingerprint = fingerprint.left(kFingerprintSize).leftJustified(kFingerprintSize, '\0');
+    m_csvLengths.assign(outputs, 0);
+    m_bits.assign(static_cast<size_t>((frames * outputs + 7) / 8), 0);
+}
+
+bool SessionManifest::load(const QString& path, int outputs, qint64 frames, const QByteArray& fingerprint)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) return false;
+    const QByteArray data = file.readAll();
+    const qint64 bitBytes = (frames * outputs + 7) / 8;
+    if (data.size() != kHeaderSize + qint64(outputs) * 8 + bitBytes) return false;
+
+    const uchar* p = reinterpret_cast<const uchar*>(data.constData());
+    const QByteArray expected = fingerprint.left(kFingerprintSize).leftJustified(kFingerprintSize, '\0');
+    if (std::memcmp(p, kMagic, sizeof(kMagic)) != 0
+        || qFromLittleEndian<quint32>(p + 8) != quint32(outputs)
+        || qFromLittleEndian<quint64>(p + 16) != quint64(frames)
+        || std::memcmp(p + 24, expected.constData(), kFingerprintSize) != 0) {
+        return false;
+    }
+
+    reset(outputs, frames, fingerprint);
+    p += kHeaderSize;
+    for (int o = 0; o < outputs; ++o, p += 8) m_csvLengths[o] = qint64(qFromLittleEndian<quint64>(p));
+    std::memcpy(m_bits.data(), p, m_bits.size());
+    return true;
+}
+
+bool SessionManifest::save(const QString& path) const
+{
+    QByteArray data;
+    data.reserve(kHeaderSize + m_outputs * 8 + qsizetype(m_bits.size()));
+    data.append(kMagic, sizeof(kMagic));
+    appendLE<quint32>(data, quint32(m_outputs));
+    appendLE<quint32>(data, 0);
+    appendLE<quint64>(data, quint64(m_frames));
+    data.append(m_fingerprint);
+    for (qint64 len : m_csvLengths) appendLE<quint64>(data, quint64(len));
+    data.append(reinterpret_cast<const char*>(m_bits.data()), qsizetype(m_bits.size()));
+
+    // 先写临时文件再原子替换，崩溃时旧清单仍然完整
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) return false;
+    file.write(data);
+    return file.commit();
+}
+
+bool SessionManifest::frameComplete(qint64 frame) const
+{
+    if (m_outputs == 0) return false;
+    for (int o = 0; o < m_outputs; ++o) {
+        if (!isDone(frame, o)) return false;
+    }
+    return true;
+}
@@ -0,0 +1,58 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <QByteArray>
+#include <QString>
+#include <vector>
+
+/**
+ * @brief 会话检查点清单（session.dipck）
+ * 记录每个 (帧, 输出) 是否已落盘，以及检查点时刻各 CSV 文件的长度。
+ * 由写出线程周期性整体替换写入（QSaveFile），中途崩溃不会留下半个清单。
+ * 重新运行同一会话（参考图、ROI、输出与帧表的指纹一致）时，已完成的帧直接跳过，
+ * CSV 截断回检查点长度，丢弃检查点之后写入但未登记的行，续写不产生重复。
+ *
+ *   0  char[8] "DIPCKP01"
+ *   8  u32     输出数 C
+ *  12  u32     保留
+ *  16  u64     帧数 N
+ *  24  u8[32]  会话指纹（SHA-256）
+ *  56  u64     各输出 CSV 长度[C]
+ *      u8      完成位图 ceil(N*C/8)，第 (f*C + o) 位对应帧 f 的输出 o
+ */
+class SessionManifest {
+public:
+    static QString fileName() { return QStringLiteral("session.dipck"); }
+
+    // 以空位图开始新会话
+    void reset(int outputs, qint64 frames, const QByteArray& fingerprint);
+    // 读取已有清单；尺寸或指纹不一致时返回 false 且保持当前内容不变
+    bool load(const QString& path, int outputs, qint64 frames, const QByteArray& fingerprint);
+    bool save(const QString& path) const;
+
+    bool isDone(qint64 frame, int output) const {
+        const qint64 bit = frame * m_outputs + output;
+        return (m_bits[bit >> 3] >> (bit & 7)) & 1;
+    }
+    void markDone(qint64 frame, int output) {
+        const qint64 bit = frame * m_outputs + output;
+        m_bits[bit >> 3] |= uchar(1u << (bit & 7));
+    }
+    // 该帧全部输出均已完成
+    bool frameComplete(qint64 frame) const;
+
+    qint64 csvLength(int output) const { return m_csvLengths[output]; }
+    void setCsvLength(int output, qint64 length) { m_csvLengths[output] = length; }
+
+    int outputs() const { return m_outputs; }
+    qint64 frames() const { return m_frames; }
+
+private:
+    int m_outputs = 0;
+    qint64 m_frames = 0;
+    QByteArray m_fingerprint;
+    std::vector<qint64> m_csvLengths;
+    std::vector<uchar> m_bits;
+};
+
+#endif // CHECKPOINT_H
@@ -0,0 +1,374 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QThreadPool>
+#include <QTimer>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+
+#include "ImgPcAlg.h"
+#include "task.h"
+#include "ImageIO.h"
+#include "pipeline.h"
+#include "twotime.h"
+#include "backend.h"
+
+// 命令行批处理：与 GUI 共用 dip_core，不依赖显示服务器
+
+static std::vector<int> parseIntList(const QString& text, bool* ok)
+{
+    std::vector<int> values;
+    *ok = true;
+    for (const QString& part : text.split(',', Qt::SkipEmptyParts)) {
+        bool partOk = false;
+        int v = part.trimmed().toInt(&partOk);
+        if (!partOk) { *ok = false; return {}; }
+        values.push_back(v);
+    }
+    return values;
+}
+
+// 去掉重复项并保留首次出现的顺序；重复的 GLCM 级数或距离会生成同名输出
+static void dropDuplicates(std::vector<int>& values)
+{
+    std::vector<int> unique;
+    for (int v : values) {
+        if (std::find(unique.begin(), unique.end(), v) == unique.end()) unique.push_back(v);
+    }
+    values.swap(unique);
+}
+
+// 输入可以是目录，也可以是 "目录/通配符" 形式，例如 /data/run1/*.bmp，
+// 或单个多帧文件（多页 TIFF / DIPRAW），逐帧处理
+static QStringList resolveInputs(const QString& input, QDir& dir)
+{
+    QFileInfo info(input);
+    if (info.isDir()) {
+        dir = QDir(info.absoluteFilePath());
+        return dir.entryList(ImageIO::nameFilters(), QDir::Files, QDir::Name);
+    }
+    dir = QDir(info.absolutePath());
+    return dir.entryList({info.fileName()}, QDir::Files, QDir::Name);
+}
+
+static void fail(const QString& msg)
+{
+    std::fprintf(stderr, "dip_batch: %s\n", qPrintable(msg));
+}
+
+// 双时间矩阵：第一遍流水线逐帧解码并写出单位特征，第二遍分块矩阵乘法
+static int runTwoTime(const QStringList& files, const QDir& dir, const QString& outDir, cv::Rect roi,
+                      const PipelineConfig& cfg, int tile)
+{
+    QStringList paths;
+    for (const QString& fileName : files) paths.append(dir.absoluteFilePath(fileName));
+    QVector<FrameSource> sources = FramePipeline::expandSources(paths);
+    if (sources.isEmpty()) { fail("no input frames found"); return 1; }
+
+    // 帧序号即矩阵的行列号
+    QFile frameList(QDir(outDir).filePath("twotime_frames.txt"));
+    if (!frameList.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+        fail("cannot write " + frameList.fileName());
+        return 1;
+    }
+    for (const FrameSource& src : sources) frameList.write(src.label.toUtf8() + '\n');
+    frameList.close();
+
+    const int total = sources.size();
+    const QString featurePath = QDir(outDir).filePath("twotime_features.dipmap");
+    auto correlator = std::make_shared<TwoTimeCorrelator>(total);
+    correlator->setFeatureFile(featurePath);
+
+    FramePipeline pipeline(std::move(sources), nullptr, cfg);
+    pipeline.setROI(roi);
+    pipeline.setFrameSink(correlator);
+    // 没有事件循环，进度由各计算线程直接回调：只有把百分比推进的那个线程输出
+    std::atomic<int> lastPercent{-1};
+    QObject::connect(&pipeline, &FramePipeline::progress, &pipeline, [&lastPercent, total](int done) {
+        const int percent = done * 100 / total;
+        int previous = lastPercent.load();
+        while (percent > previous) {
+            if (lastPercent.compare_exchange_weak(previous, percent)) {
+                std::fprintf(stderr, "\rfeatures %d/%d (%d%%)", done, total, percent);
+                break;
+            }
+        }
+    }, Qt::DirectConnection);
+    pipeline.start();
+    pipeline.wait();
+    correlator->closeFeatures();
+    std::fprintf(stderr, "\n");
+
+    const QString matrixPath = QDir(outDir).filePath("twotime.dipmat");
+    if (!TwoTimeCorrelator::computeMatrix(featurePath, matrixPath, cfg.computeThreads, tile)) {
+        fail("failed to compute the two-time matrix");
+        return 1;
+    }
+    QFile::remove(featurePath);
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("dip_batch");
+    BufferPool::install();
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Headless batch processing of speckle image sequences.");
+    parser.addHelpOption();
+
+    QCommandLineOption refOpt({"r", "ref"}, "Reference image.", "file");
+    QCommandLineOption inputOpt({"i", "input"}, "Input directory, glob (e.g. dir/*.bmp) or multi-frame stack (.tif/.dipraw).", "path");
+    QCommandLineOption outputOpt({"o", "output"}, "Output directory for result files.", "dir");
+    QCommandLineOption algsOpt({"a", "algs"},
+                               QString("Comma-separated algorithms (%1).")
+                                   .arg(QStringList({MSVNAME, NIPCNAME, ZNCCNAME, ZNCCSHIFTNAME, LOCALZNCCNAME, LOCALNIPCNAME, CORRNAME, HOMONAME})
+                                            .join(", ")),
+                               "list");
+    QCommandLineOption roiOpt("roi", "Region of interest as x,y,w,h.", "rect");
+    QCommandLineOption regionsOpt("regions",
+                                  "Sub-regions inside the ROI as x,y,w,h;x,y,w,h;... Outputs are named <alg>@R<index>.",
+                                  "list");
+    QCommandLineOption gridOpt("grid", "Tile the ROI with w,h sub-regions (optionally w,h,sx,sy for a custom stride).", "cell");
+    QCommandLineOption threadsOpt({"j", "threads"}, "Worker thread count (default: all cores).", "n");
+    QCommandLineOption ioOpt("io-threads", "Threads prefetching file bytes.", "n", "2");
+    QCommandLineOption decodeOpt("decode-threads", "Threads decoding images.", "n", "2");
+    QCommandLineOption depthOpt("queue-depth", "Frames buffered between stages (default: 2x compute threads).", "n");
+    QCommandLineOption chunkOpt("chunk", "Contiguous frames per work unit (default: automatic).", "n");
+    QCommandLineOption formatOpt("format", "Result format: csv, binary (columnar results.dipres) or both.", "fmt", "csv");
+    QCommandLineOption noResumeOpt("no-resume", "Ignore an existing checkpoint in the output directory and process every frame.");
+    QCommandLineOption shiftOpt("shift", "Search radius in pixels for ZNCCshift.", "px", QString::number(maxShift));
+    QCommandLineOption windowOpt("map-window", "Odd sliding-window size for localZNCC/localNIPC maps.", "px",
+                                 QString::number(mapWindow));
+    QCommandLineOption mapScaleOpt("map-scale",
+                                   "Downsampling factor for per-frame correlation maps (<output>.dipmap); 0 disables them.",
+                                   "n", "1");
+    QCommandLineOption lagsOpt("lags",
+                               "Comma-separated frame lags k; adds NIPC_lag<k>/ZNCC_lag<k> between frame i and i-k "
+                               "for the selected NIPC/ZNCC.", "list");
+    QCommandLineOption scalesOpt("scales",
+                                 "Comma-separated downsampling factors, e.g. 1,2,4,8; MSV/NIPC/ZNCC are evaluated at "
+                                 "each and named <alg>_x<f>. Powers of two share one pyramid per frame.", "list");
+    QCommandLineOption backendOpt("backend",
+                                  "Compute backend: auto, cpu or opencl, or per stage as "
+                                  "correlation=<b>,spectrum=<b>. auto benchmarks both on the first frame size.",
+                                  "spec", "auto");
+    QCommandLineOption twoTimeOpt("two-time",
+                                  "Write the NIPC matrix between every pair of frames to twotime.dipmat instead of "
+                                  "correlating against a reference; --ref and --algs are not needed.");
+    QCommandLineOption tileOpt("tile", "Frames per block of the two-time matrix product.", "n", "256");
+    QCommandLineOption levelsOpt("glcm-levels", "Comma-separated GLCM level counts.", "list", "32");
+    QCommandLineOption distOpt("glcm-distances",
+                               "Comma-separated GLCM distances; each adds the 0/45/90/135 degree offsets. "
+                               "Default is the single offset (1, 0).", "list");
+    parser.addOptions({refOpt, inputOpt, outputOpt, algsOpt, roiOpt, regionsOpt, gridOpt, threadsOpt, ioOpt, decodeOpt, depthOpt, chunkOpt, formatOpt, noResumeOpt, shiftOpt, windowOpt, mapScaleOpt, lagsOpt, scalesOpt, backendOpt, twoTimeOpt, tileOpt, levelsOpt, distOpt});
+    parser.process(app);
+
+    // 双时间矩阵只在序列内部两两相关，不需要参考图与算法列表
+    const bool twoTime = parser.isSet(twoTimeOpt);
+    QList<QCommandLineOption> requiredOpts = {inputOpt, outputOpt};
+    if (!twoTime) requiredOpts = {refOpt, inputOpt, outputOpt, algsOpt};
+    for (const QCommandLineOption& required : requiredOpts) {
+        if (!parser.isSet(required)) {
+            fail(QString("missing required option --%1").arg(required.names().last()));
+            return 2;
+        }
+    }
+
+    registerDefaultAlgs();
+    bool ok = false;
+    const int shift = parser.value(shiftOpt).toInt(&ok);
+    if (!ok || shift < 0) { fail("invalid --shift"); return 2; }
+    AlgRegistry<QString>::instance().Register(ZNCCSHIFTNAME, [shift](cv::InputArray img){
+        return std::make_unique<ZNCCShiftAlg>(img, shift);
+    });
+    const int window = parser.value(windowOpt).toInt(&ok);
+    if (!ok || window < 3 || window % 2 == 0) { fail("invalid --map-window, expected an odd size >= 3"); return 2; }
+    AlgRegistry<QString>::instance().Register(LOCALZNCCNAME, [window](cv::InputArray img){
+        return std::make_unique<LocalCorrAlg>(img, LocalCorrAlg::Mode::ZNCC, window);
+    });
+    AlgRegistry<QString>::instance().Register(LOCALNIPCNAME, [window](cv::InputArray img){
+        return std::make_unique<LocalCorrAlg>(img, LocalCorrAlg::Mode::NIPC, window);
+    });
+    const int mapScale = parser.value(mapScaleOpt).toInt(&ok);
+    if (!ok || mapScale < 0) { fail("invalid --map-scale"); return 2; }
+    QVector<int> lags;
+    if (parser.isSet(lagsOpt)) {
+        for (int k : parseIntList(parser.value(lagsOpt), &ok)) lags.append(k);
+        if (!ok || lags.isEmpty() || std::any_of(lags.begin(), lags.end(), [](int k) { return k < 1; })) {
+            fail("invalid --lags, expected positive integers");
+            return 2;
+        }
+    }
+
+    QVector<int> scales;
+    if (parser.isSet(scalesOpt)) {
+        for (int f : parseIntList(parser.value(scalesOpt), &ok)) scales.append(f);
+        if (!ok || scales.isEmpty() || std::any_of(scales.begin(), scales.end(), [](int f) { return f < 1; })) {
+            fail("invalid --scales, expected positive integers");
+            return 2;
+        }
+    }
+
+    if (!Backend::configure(parser.value(backendOpt))) {
+        fail("invalid --backend, expected auto, cpu, opencl or stage=backend,...");
+        return 2;
+    }
+
+    // 算法列表
+    QVector<QString> algs;
+    for (const QString& name : parser.value(algsOpt).split(',', Qt::SkipEmptyParts)) {
+        QString n = name.trimmed();
+        if (!AlgRegistry<QString>::instance().names().contains(n) && n != CORRNAME && n != HOMONAME) {
+            fail(QString("unknown algorithm '%1'").arg(n));
+            return 2;
+        }
+        if (!algs.contains(n)) algs.emplaceBack(n);
+    }
+    if (algs.isEmpty() && !twoTime) { fail("no algorithm selected"); return 2; }
+
+    // GLCM 请求
+    GLCM::GLCMRequest glcmReq;
+    glcmReq.levels = parseIntList(parser.value(levelsOpt), &ok);
+    if (!ok || glcmReq.levels.empty()) { fail("invalid --glcm-levels"); return 2; }
+    for (int l : glcmReq.levels) {
+        if (l < 2 || l > 256) { fail("GLCM levels must be in [2, 256]"); return 2; }
+    }
+    dropDuplicates(glcmReq.levels);
+    if (parser.isSet(distOpt)) {
+        std::vector<int> distances = parseIntList(parser.value(distOpt), &ok);
+        if (!ok || distances.empty() || std::any_of(distances.begin(), distances.end(), [](int d) { return d < 1; })) {
+            fail("invalid --glcm-distances, expected positive integers");
+            return 2;
+        }
+        dropDuplicates(distances);
+        glcmReq.offsets = GLCM::GLCMRequest::directionalOffsets(distances);
+    }
+
+    // ROI
+    cv::Rect roi;
+    if (parser.isSet(roiOpt)) {
+        std::vector<int> r = parseIntList(parser.value(roiOpt), &ok);
+        if (!ok || r.size() != 4 || r[2] <= 0 || r[3] <= 0) { fail("invalid --roi, expected x,y,w,h"); return 2; }
+        roi = cv::Rect(r[0], r[1], r[2], r[3]);
+    }
+
+    // 参考图
+    cv::Mat refImg;
+    if (!twoTime) {
+        refImg = imread_safe(parser.value(refOpt));
+        if (refImg.empty()) { fail("cannot read reference image " + parser.value(refOpt)); return 1; }
+        if (roi.area() > 0) {
+            if ((roi & cv::Rect(0, 0, refImg.cols, refImg.rows)) != roi) { fail("ROI lies outside the reference image"); return 2; }
+            refImg = refImg(roi).clone();
+        }
+    }
+
+    // 子区域：坐标相对 ROI，所有区域共享每帧的一次解码
+    QVector<cv::Rect> regions;
+    if (parser.isSet(regionsOpt)) {
+        for (const QString& part : parser.value(regionsOpt).split(';', Qt::SkipEmptyParts)) {
+            std::vector<int> r = parseIntList(part, &ok);
+            if (!ok || r.size() != 4 || r[2] <= 0 || r[3] <= 0) { fail("invalid --regions, expected x,y,w,h;..."); return 2; }
+            regions.append(cv::Rect(r[0], r[1], r[2], r[3]));
+        }
+    }
+    if (parser.isSet(gridOpt)) {
+        std::vector<int> g = parseIntList(parser.value(gridOpt), &ok);
+        if (!ok || (g.size() != 2 && g.size() != 4) || g[0] <= 0 || g[1] <= 0 || (g.size() == 4 && (g[2] <= 0 || g[3] <= 0))) {
+            fail("invalid --grid, expected w,h or w,h,sx,sy");
+            return 2;
+        }
+        const cv::Size stride = g.size() == 4 ? cv::Size(g[2], g[3]) : cv::Size();
+        regions += ProcessingSession::gridRegions(refImg.size(), cv::Size(g[0], g[1]), stride);
+    }
+    for (const cv::Rect& r : regions) {
+        if ((r & cv::Rect(0, 0, refImg.cols, refImg.rows)) != r) { fail("a region lies outside the ROI"); return 2; }
+    }
+    if ((parser.isSet(regionsOpt) || parser.isSet(gridOpt)) && regions.isEmpty()) { fail("no region fits inside the ROI"); return 2; }
+
+    // 输入文件
+    QDir dir;
+    QStringList files = resolveInputs(parser.value(inputOpt), dir);
+    if (files.isEmpty()) { fail("no input images found"); return 1; }
+
+    // 输出目录
+    const QString outDir = parser.value(outputOpt);
+    if (!QDir().mkpath(outDir)) { fail("cannot create output directory " + outDir); return 1; }
+
+    PipelineConfig pipelineCfg;
+    if (parser.isSet(threadsOpt)) {
+        int threads = parser.value(threadsOpt).toInt(&ok);
+        if (!ok || threads < 1) { fail("invalid --threads"); return 2; }
+        QThreadPool::globalInstance()->setMaxThreadCount(threads);
+        pipelineCfg.computeThreads = threads;
+    }
+    pipelineCfg.ioThreads = parser.value(ioOpt).toInt(&ok);
+    if (!ok || pipelineCfg.ioThreads < 1) { fail("invalid --io-threads"); return 2; }
+    pipelineCfg.decodeThreads = parser.value(decodeOpt).toInt(&ok);
+    if (!ok || pipelineCfg.decodeThreads < 1) { fail("invalid --decode-threads"); return 2; }
+    if (parser.isSet(depthOpt)) {
+        pipelineCfg.queueDepth = parser.value(depthOpt).toInt(&ok);
+        if (!ok || pipelineCfg.queueDepth < 1) { fail("invalid --queue-depth"); return 2; }
+    }
+    if (parser.isSet(chunkOpt)) {
+        pipelineCfg.chunkFrames = parser.value(chunkOpt).toInt(&ok);
+        if (!ok || pipelineCfg.chunkFrames < 1) { fail("invalid --chunk"); return 2; }
+    }
+
+    if (twoTime) {
+        const int tile = parser.value(tileOpt).toInt(&ok);
+        if (!ok || tile < 1) { fail("invalid --tile"); return 2; }
+        return runTwoTime(files, dir, outDir, roi, pipelineCfg, tile);
+    }
+
+    const QString format = parser.value(formatOpt).toLower();
+    int formats = 0;
+    if (format == "csv") formats = ResultCollector::Csv;
+    else if (format == "binary") formats = ResultCollector::Binary;
+    else if (format == "both") formats = ResultCollector::Csv | ResultCollector::Binary;
+    else { fail("invalid --format, expected csv, binary or both"); return 2; }
+
+    ResultCollector collector;
+    collector.setOutputDir(outDir);
+    collector.setFormats(formats);
+    collector.setResume(!parser.isSet(noResumeOpt));
+    collector.setMapScale(mapScale);
+    collector.prepare();
+
+    TaskManager engine(&collector);
+    ProcessingSession* session = engine.createSession();
+    session->setParent(&app);
+    session->setROI(roi);
+    session->setRegions(regions);
+    session->setGLCMRequest(glcmReq);
+    session->setPipelineConfig(pipelineCfg);
+    session->setLags(lags);
+    session->setScales(scales);
+    session->setResumeTag("shift=" + QByteArray::number(shift) + ";window=" + QByteArray::number(window));
+
+    int lastPercent = -1;
+    QObject::connect(session, &ProcessingSession::progressUpdated, &app, [&lastPercent](int current, int total) {
+        int percent = total > 0 ? current * 100 / total : 100;
+        if (percent != lastPercent) {
+            lastPercent = percent;
+            std::fprintf(stderr, "\r%d/%d (%d%%)", current, total, percent);
+        }
+    });
+    QObject::connect(session, &ProcessingSession::sessionFinished, &app, [&collector]() {
+        collector.closeAll();
+        std::fprintf(stderr, "\n");
+        QCoreApplication::quit();
+    });
+
+    // 事件循环启动后再开始，保证 sessionFinished 即使同步发出也能正常退出
+    QTimer::singleShot(0, session, [=]() {
+        session->start(refImg, files, dir, algs);
+    });
+
+    return app.exec();
+}
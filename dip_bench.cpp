@@ -0,0 +1,307 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QTextStream>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+
+#include "ImgPcAlg.h"
+#include "GradKernel.h"
+#include "bufferpool.h"
+
+// 微基准：覆盖每个 AlgInterface 实现与各流水线阶段，输入为确定性的合成散斑图
+
+namespace {
+
+struct BenchCase {
+    QString stage;
+    int width = 0, height = 0;
+    int roi = 0;       // 0 表示整帧
+    int factor = 1;
+    int levels = 0;
+    QString padding;
+};
+
+struct BenchResult {
+    BenchCase c;
+    int iterations = 0;
+    double meanUs = 0, medianUs = 0, minUs = 0;
+    double mpixPerSec = 0;
+};
+
+/**
+ * @brief 确定性散斑图
+ * 随机相位的复场经圆形光瞳低通后取强度；correlation 给出与 seed 场的相关程度，
+ * 用于构造与参考部分去相关的输入帧
+ */
+cv::Mat makeSpeckle(cv::Size size, int grain, uint64 seed, uint64 mixSeed = 0, double correlation = 1.0)
+{
+    auto randomField = [&](uint64 s) {
+        cv::RNG rng(s);
+        cv::Mat phase(size, CV_32F);
+        rng.fill(phase, cv::RNG::UNIFORM, 0.0, 2.0 * CV_PI);
+        cv::Mat re, im;
+        cv::polarToCart(cv::Mat::ones(size, CV_32F), phase, re, im);
+        cv::Mat field;
+        cv::merge(std::vector<cv::Mat>{ re, im }, field);
+        return field;
+    };
+
+    cv::Mat field = randomField(seed);
+    if (correlation < 1.0) {
+        cv::Mat other = randomField(mixSeed);
+        cv::addWeighted(field, correlation, other, std::sqrt(1.0 - correlation * correlation), 0.0, field);
+    }
+
+    // 光瞳半径决定散斑颗粒大小
+    cv::Mat spec;
+    cv::dft(field, spec);
+    cv::Mat pupil = cv::Mat::zeros(size, CV_32FC2);
+    const int radius = std::max(1, std::min(size.width, size.height) / (2 * grain));
+    for (const cv::Point& c : { cv::Point(0, 0), cv::Point(size.width, 0), cv::Point(0, size.height), cv::Point(size.width, size.height) })
+        cv::circle(pupil, c, radius, cv::Scalar(1, 0), cv::FILLED);
+    cv::mulSpectrums(spec, pupil, spec, 0);
+    cv::idft(spec, field, cv::DFT_SCALE);
+
+    std::vector<cv::Mat> planes;
+    cv::split(field, planes);
+    cv::Mat intensity;
+    cv::magnitude(planes[0], planes[1], intensity);
+    cv::multiply(intensity, intensity, intensity);
+
+    cv::Mat out;
+    cv::normalize(intensity, out, 0, 255, cv::NORM_MINMAX, CV_8U);
+    return out;
+}
+
+cv::Mat centerRoi(const cv::Mat& img, int roi)
+{
+    if (roi <= 0 || roi >= std::min(img.cols, img.rows)) return img;
+    return img(cv::Rect((img.cols - roi) / 2, (img.rows - roi) / 2, roi, roi)).clone();
+}
+
+class Bench {
+public:
+    Bench(double minTimeSec, int maxIters) : m_minTime(minTimeSec), m_maxIters(maxIters) {}
+
+    void run(const BenchCase& c, const std::function<double()>& body, double pixels)
+    {
+        volatile double sink = body(); // 预热：线程缓冲区、OpenCL 内核等一次性开销不计入
+        std::vector<double> samples;
+        double total = 0;
+        while ((total < m_minTime || samples.size() < 3) && static_cast<int>(samples.size()) < m_maxIters) {
+            auto t0 = std::chrono::steady_clock::now();
+            sink = sink + body();
+            auto t1 = std::chrono::steady_clock::now();
+            double dt = std::chrono::duration<double>(t1 - t0).count();
+            samples.push_back(dt);
+            total += dt;
+        }
+        (void)sink;
+
+        BenchResult r;
+        r.c = c;
+        r.iterations = static_cast<int>(samples.size());
+        std::sort(samples.begin(), samples.end());
+        r.minUs = samples.front() * 1e6;
+        r.medianUs = samples[samples.size() / 2] * 1e6;
+        r.meanUs = total / samples.size() * 1e6;
+        r.mpixPerSec = r.medianUs > 0 ? pixels / r.medianUs : 0;
+        m_results.push_back(r);
+
+        std::fprintf(stderr, "%-22s %5dx%-5d roi=%-5d f=%d L=%-3d %-8s median %10.1f us\n",
+                     qPrintable(c.stage), c.width, c.height, c.roi, c.factor, c.levels,
+                     qPrintable(c.padding), r.medianUs);
+    }
+
+    const std::vector<BenchResult>& results() const { return m_results; }
+
+private:
+    double m_minTime;
+    int m_maxIters;
+    std::vector<BenchResult> m_results;
+};
+
+void writeCsv(QTextStream& out, const std::vector<BenchResult>& results)
+{
+    out << "stage,width,height,roi,factor,levels,padding,iterations,mean_us,median_us,min_us,mpix_per_s\n";
+    for (const BenchResult& r : results) {
+        out << r.c.stage << "," << r.c.width << "," << r.c.height << "," << r.c.roi << ","
+            << r.c.factor << "," << r.c.levels << "," << r.c.padding << "," << r.iterations << ","
+            << QString::number(r.meanUs, 'f', 3) << "," << QString::number(r.medianUs, 'f', 3) << ","
+            << QString::number(r.minUs, 'f', 3) << "," << QString::number(r.mpixPerSec, 'f', 3) << "\n";
+    }
+}
+
+void writeJson(QTextStream& out, const std::vector<BenchResult>& results)
+{
+    out << "{\n  \"isa\": \"" << GradKernel::isaName() << "\",\n"
+        << "  \"threads\": " << cv::getNumThreads() << ",\n"
+        << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        out << "    {\"stage\": \"" << r.c.stage << "\", \"width\": " << r.c.width << ", \"height\": " << r.c.height
+            << ", \"roi\": " << r.c.roi << ", \"factor\": " << r.c.factor << ", \"levels\": " << r.c.levels
+            << ", \"padding\": \"" << r.c.padding << "\", \"iterations\": " << r.iterations
+            << ", \"mean_us\": " << QString::number(r.meanUs, 'f', 3)
+            << ", \"median_us\": " << QString::number(r.medianUs, 'f', 3)
+            << ", \"min_us\": " << QString::number(r.minUs, 'f', 3)
+            << ", \"mpix_per_s\": " << QString::number(r.mpixPerSec, 'f', 3) << "}"
+            << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+}
+
+std::vector<int> parseList(const QString& text)
+{
+    std::vector<int> v;
+    for (const QString& part : text.split(',', Qt::SkipEmptyParts)) {
+        bool ok = false;
+        int x = part.trimmed().toInt(&ok);
+        if (ok) v.push_back(x);
+    }
+    return v;
+}
+
+QString paddingName(PaddingStrategy s)
+{
+    return s == PaddingStrategy::None ? "None" : "Optimal";
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("dip_bench");
+    // 与批处理一致，计时包含缓冲池复用的效果
+    BufferPool::install();
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Microbenchmarks for the DIP algorithms and pipeline stages.");
+    parser.addHelpOption();
+    QCommandLineOption sizesOpt("sizes", "Comma-separated square frame sizes.", "list", "256,512,1024,2048");
+    QCommandLineOption roisOpt("rois", "Comma-separated square ROI sizes (0 = full frame).", "list", "0,256");
+    QCommandLineOption factorsOpt("factors", "Comma-separated downsample factors.", "list", "1,2,4");
+    QCommandLineOption levelsOpt("levels", "Comma-separated GLCM level counts.", "list", "8,16,32,64");
+    QCommandLineOption formatOpt("format", "Output format: csv or json.", "fmt", "csv");
+    QCommandLineOption outputOpt({"o", "output"}, "Output file (default: stdout).", "file");
+    QCommandLineOption minTimeOpt("min-time", "Minimum measured time per case in seconds.", "sec", "0.2");
+    QCommandLineOption maxItersOpt("max-iters", "Maximum iterations per case.", "n", "1000");
+    QCommandLineOption seedOpt("seed", "Seed of the synthetic speckle generator.", "n", "12345");
+    parser.addOptions({sizesOpt, roisOpt, factorsOpt, levelsOpt, formatOpt, outputOpt, minTimeOpt, maxItersOpt, seedOpt});
+    parser.process(app);
+
+    const std::vector<int> sizes = parseList(parser.value(sizesOpt));
+    const std::vector<int> rois = parseList(parser.value(roisOpt));
+    const std::vector<int> factors = parseList(parser.value(factorsOpt));
+    const std::vector<int> levelsList = parseList(parser.value(levelsOpt));
+    const uint64 seed = parser.value(seedOpt).toULongLong();
+    Bench bench(parser.value(minTimeOpt).toDouble(), std::max(1, parser.value(maxItersOpt).toInt()));
+
+    for (int size : sizes) {
+        const cv::Mat refFull = makeSpeckle(cv::Size(size, size), 4, seed);
+        const cv::Mat inFull = makeSpeckle(cv::Size(size, size), 4, seed, seed + 1, 0.8);
+
+        BenchCase crop{ "roi_crop", size, size, 256, 1, 0, "" };
+        if (size > 256) {
+            bench.run(crop, [&]() { return static_cast<double>(centerRoi(inFull, 256).total()); }, 256.0 * 256.0);
+        }
+
+        for (int roi : rois) {
+            if (roi > 0 && roi >= size) continue;
+            const cv::Mat ref = centerRoi(refFull, roi);
+            const cv::Mat in = centerRoi(inFull, roi);
+            const double pixels = static_cast<double>(in.total());
+            BenchCase base{ "", size, size, roi, 1, 0, "" };
+
+            cv::UMat inF;
+            in.convertTo(inF, CV_32F);
+
+            BenchCase c = base;
+            c.stage = "preTreat";
+            bench.run(c, [&]() { return static_cast<double>(preTreat(inF).total()); }, pixels);
+
+            cv::UMat grad = preTreat(inF);
+            for (int f : factors) {
+                c = base; c.stage = "downsample"; c.factor = f;
+                bench.run(c, [&]() { cv::UMat d; downsampleBy(grad, d, f); return static_cast<double>(d.total()); }, pixels);
+
+                c.stage = "NIPCAlg";
+                NIPCAlg nipc(ref, f);
+                bench.run(c, [&]() { return nipc.process(in); }, pixels);
+
+                c.stage = "ZNCCAlg";
+                ZNCCAlg zncc(ref, f);
+                bench.run(c, [&]() { return zncc.process(in); }, pixels);
+
+                c.stage = "ZNCCShiftAlg";
+                ZNCCShiftAlg znccShift(ref, maxShift, f);
+                bench.run(c, [&]() { return znccShift.process(in); }, pixels);
+
+                // 局部相关图：boxFilter 滑动窗口，成本应与窗口大小无关
+                for (int window : { 7, 31 }) {
+                    if (window > std::min(ref.cols, ref.rows) / f) continue;
+                    c.stage = QString("LocalZNCC w%1").arg(window);
+                    LocalCorrAlg localZncc(ref, LocalCorrAlg::Mode::ZNCC, window, f);
+                    bench.run(c, [&]() { return localZncc.process(in); }, pixels);
+                }
+
+                // 多个相关类指标共享同一帧中间量时的总成本
+                c.stage = "NIPC+ZNCC shared";
+                bench.run(c, [&]() { FrameContext frame(in); return nipc.processFrame(frame) + zncc.processFrame(frame); }, pixels);
+            }
+
+            c = base; c.stage = "MSVAlg";
+            MSVAlg msv(ref);
+            bench.run(c, [&]() { return msv.process(in); }, pixels);
+
+            for (PaddingStrategy pad : { PaddingStrategy::None, PaddingStrategy::ToOptimalDFT }) {
+                for (int levels : levelsList) {
+                    c = base; c.levels = levels; c.padding = paddingName(pad);
+                    c.stage = "getPhaseSpecInternal";
+                    bench.run(c, [&]() { return static_cast<double>(GLCM::getPhaseSpecInternal(in, levels, pad).total()); }, pixels);
+                }
+            }
+
+            for (int levels : levelsList) {
+                const cv::Mat phase = GLCM::getPhaseSpecInternal(in, levels);
+                c = base; c.levels = levels;
+
+                c.stage = "GLCmat";
+                bench.run(c, [&]() { GLCM::GLCmat g(phase, levels, 1, 0); return g.getCorrelation(); }, pixels);
+
+                GLCM::GLCmat glcm(phase, levels, 1, 0);
+                c.stage = "GLCmat::getCorrelation";
+                bench.run(c, [&]() { return glcm.getCorrelation(); }, pixels);
+                c.stage = "GLCmat::getHomogeneity";
+                bench.run(c, [&]() { return glcm.getHomogeneity(); }, pixels);
+
+                GLCM::GLCMRequest req;
+                req.levels = { levels };
+                req.offsets = GLCM::GLCMRequest::directionalOffsets({ 1 });
+                c.stage = "GLCMSet 4 directions";
+                c.padding = paddingName(req.strategy);
+                bench.run(c, [&]() { GLCM::GLCMSet set(in, req); return static_cast<double>(set.matrices(levels).size()); }, pixels);
+            }
+        }
+    }
+
+    QFile file;
+    if (parser.isSet(outputOpt)) {
+        file.setFileName(parser.value(outputOpt));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+            std::fprintf(stderr, "dip_bench: cannot open %s\n", qPrintable(parser.value(outputOpt)));
+            return 1;
+        }
+    } else if (!file.open(stdout, QIODevice::WriteOnly | QIODevice::Text)) {
+        return 1;
+    }
+
+    QTextStream out(&file);
+    if (parser.value(formatOpt).compare("json", Qt::CaseInsensitive) == 0) writeJson(out, bench.results());
+    else writeCsv(out, bench.results());
+    return 0;
+}
@@ -1,10 +1,13 @@
 #include "mainwindow.h"
+#include "bufferpool.h"
 
 #include <QApplication>
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
+    // 逐帧中间图从各线程的缓冲池复用
+    BufferPool::install();
     MainWindow w;
     w.show();
     return a.exec();
@@ -2,9 +2,10 @@
 #include "ImgPcAlg.h"
 #include "ui_mainwindow.h"
 #include "roi.h"
+#include "ImageIO.h"
 
 #include <QFileDialog>
-#include <QThreadPool>
+#include <QInputDialog>
 #include <QMessageBox>
 
 MainWindow::MainWindow(QWidget *parent)
@@ -16,14 +17,14 @@ MainWindow::MainWindow(QWidget *parent)
     myScene = new QGraphicsScene(this);
     ui->graphicsView->setScene(myScene);
 
-    int idealThreadCount = QThread::idealThreadCount();
-    int maxThreads = qMax(2, idealThreadCount / 2);
-    QThreadPool::globalInstance()->setMaxThreadCount(maxThreads);
+    // 默认留一半核心给界面与 I/O，可在“设置”菜单中调整
+    workerCount = qMax(2, QThread::idealThreadCount() / 2);
 
     connect(ui->pushButton, &QPushButton::clicked, this, &MainWindow::showFile);
     connect(ui->pushButton_2, &QPushButton::clicked, this, &MainWindow::showDir);
     connect(ui->pushButton_5, &QPushButton::clicked, this, &MainWindow::showOutDir);
     connect(ui->actionROI, &QAction::triggered, this, &MainWindow::selectROI);
+    connect(ui->actionWorkers, &QAction::triggered, this, &MainWindow::selectWorkers);
     connect(ui->pushButton_3, &QPushButton::clicked, this, [this](){
         ui->pushButton_4->setEnabled(true);
         if (taskEngine) {
@@ -37,15 +38,7 @@ MainWindow::MainWindow(QWidget *parent)
 
     // connect(ui->actionMSV, &QAction::toggled,
     //         this, &MainWindow::registerMSV);
-    AlgRegistry<QString>::instance().Register(MSVNAME, [](cv::InputArray img){
-        return std::make_unique<MSVAlg>(img);
-    });
-    AlgRegistry<QString>::instance().Register(NIPCNAME, [](cv::InputArray img){
-        return std::make_unique<NIPCAlg>(img);
-    });
-    AlgRegistry<QString>::instance().Register(ZNCCNAME, [](cv::InputArray img){
-        return std::make_unique<ZNCCAlg>(img);
-    });
+    registerDefaultAlgs();
     // AlgRegistry<QString>::instance().Register(CORRNAME, [](cv::InputArray img){
     //     return std::make_unique<GLCM::GLCMcorrAlg>(img);
     // });
@@ -100,6 +93,8 @@ void MainWindow::selectROI()
 
     // 1. 加载参考图并转换为 QImage
     cv::Mat ref = imread_safe(filePath);
+    // 12/16 位数据按实际范围拉伸到 8 位显示，计算仍使用原始位深
+    if (ref.depth() != CV_8U) cv::normalize(ref, ref, 0, 255, cv::NORM_MINMAX, CV_8U);
     QImage qimg = QImage(ref.data, ref.cols, ref.rows, ref.step, QImage::Format_Grayscale8).copy();
 
     // 2. 弹出 ROI 窗口
@@ -126,6 +121,14 @@ void MainWindow::selectROI()
 
 }
 
+void MainWindow::selectWorkers()
+{
+    bool ok = false;
+    int n = QInputDialog::getInt(this, tr("工作线程数"), tr("计算线程数（下一次批处理生效）："),
+                                 workerCount, 1, qMax(1, QThread::idealThreadCount() * 2), 1, &ok);
+    if (ok) workerCount = n;
+}
+
 void MainWindow::MainExecute()
 {
     if(filePath.isEmpty()) QMessageBox::warning(this, "noRef",
@@ -141,6 +144,9 @@ void MainWindow::MainExecute()
 
         ProcessingSession* session = taskEngine->createSession();
         session->setROI(currentROI);
+        PipelineConfig pipelineCfg;
+        pipelineCfg.computeThreads = workerCount;
+        session->setPipelineConfig(pipelineCfg);
         connect(ui->pushButton_3, &QPushButton::clicked, session, &ProcessingSession::cancel);
 
         connect(session, &ProcessingSession::sessionFinished, this, [this, session](){
@@ -152,7 +158,7 @@ void MainWindow::MainExecute()
         });
 
         QDir dir(dirPath);
-        QStringList files = dir.entryList({"*.bmp", "*.png", "*.jpg"}, QDir::Files);
+        QStringList files = dir.entryList(ImageIO::nameFilters(), QDir::Files);
         cv::Mat refImg = imread_safe(filePath);
         refImg = currentROI.width > 0 && currentROI.height > 0 ?
                      refImg(currentROI).clone() : refImg;
@@ -161,8 +167,11 @@ void MainWindow::MainExecute()
         if(ui->actionMSV->isChecked())selectedChoices.emplaceBack(MSVNAME);
         if(ui->actionNIPC->isChecked())selectedChoices.emplaceBack(NIPCNAME);
         if(ui->actionZNCC->isChecked())selectedChoices.emplaceBack(ZNCCNAME);
+        if(ui->actionZNCCshift->isChecked())selectedChoices.emplaceBack(ZNCCSHIFTNAME);
         if(ui->actionCorrelation->isChecked())selectedChoices.emplaceBack(CORRNAME);
         if(ui->actionHomogeneity->isChecked())selectedChoices.emplaceBack(HOMONAME);
+        if(ui->actionLocalZNCC->isChecked())selectedChoices.emplaceBack(LOCALZNCCNAME);
+        if(ui->actionLocalNIPC->isChecked())selectedChoices.emplaceBack(LOCALNIPCNAME);
         // taskEngine->ExecuteSelected(filePath, dirPath, selectedChoices);
         if(selectedChoices.isEmpty()) {
             QMessageBox::warning(this, "noChoice",
@@ -27,6 +27,7 @@ private:
     QGraphicsScene* myScene;
 
     QVector<QString> selectedChoices;
+    int workerCount; // 计算线程数
     ResultCollector collector;
     // std::unique_ptr<AlgInterface> basePtr;
     std::unique_ptr<TaskManager> taskEngine;
@@ -41,6 +42,7 @@ private slots:
 
     // void check();
     void selectROI();
+    void selectWorkers();
     void MainExecute();
 };
 
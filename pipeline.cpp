@@ -0,0 +1,186 @@
+#include "pipeline.h"
+#include "backend.h"
+#include <QThreadPool>
+#include <QFileInfo>
+#include <QDebug>
+#include <algorithm>
+
+FramePipeline::FramePipeline(QVector<FrameSource> sources, std::shared_ptr<const FrameProcessor> processor,
+                             const PipelineConfig& cfg, QObject* parent)
+    : QObject(parent), m_sources(std::move(sources)), m_processor(std::move(processor)), m_cfg(cfg)
+{
+    if (m_cfg.ioThreads < 1) m_cfg.ioThreads = 1;
+    if (m_cfg.decodeThreads < 1) m_cfg.decodeThreads = 1;
+    if (m_cfg.computeThreads < 1) m_cfg.computeThreads = std::max(1, QThreadPool::globalInstance()->maxThreadCount());
+    if (m_cfg.queueDepth < 1) m_cfg.queueDepth = 2 * m_cfg.computeThreads;
+    // 默认区段长度：每个计算线程约分得 8 个区段，留出窃取的余地
+    m_chunkFrames = m_cfg.chunkFrames > 0 ? m_cfg.chunkFrames
+                                          : std::clamp(static_cast<int>(m_sources.size()) / (8 * m_cfg.computeThreads), 1, 32);
+
+    m_rawQueue.setCapacity(m_cfg.queueDepth);
+    m_decodedQueue.reset(m_cfg.computeThreads, m_cfg.queueDepth);
+}
+
+QVector<FrameSource> FramePipeline::expandSources(const QStringList& paths)
+{
+    QVector<FrameSource> sources;
+    sources.reserve(paths.size());
+    for (const QString& path : paths) {
+        const QString name = QFileInfo(path).fileName();
+        const QString suffix = QFileInfo(path).suffix().toLower();
+        // 只有可能含多帧的格式才需要打开建立索引
+        std::shared_ptr<const ImageIO::FrameStack> stack;
+        if (suffix == "tif" || suffix == "tiff" || suffix == "dipraw")
+            stack = ImageIO::FrameStack::open(path);
+
+        if (stack && stack->size() > 1) {
+            for (int k = 0; k < stack->size(); ++k)
+                sources.append({path, QString("%1#%2").arg(name).arg(k), stack, k});
+        } else {
+            sources.append({path, name, stack, 0});
+        }
+    }
+    return sources;
+}
+
+FramePipeline::~FramePipeline()
+{
+    cancel();
+    wait();
+    for (QThread* t : m_threads) delete t;
+}
+
+void FramePipeline::start()
+{
+    if (!m_threads.empty()) return;
+
+    m_ioAlive = m_cfg.ioThreads;
+    m_decodeAlive = m_cfg.decodeThreads;
+    m_threadsAlive = m_cfg.ioThreads + m_cfg.decodeThreads + m_cfg.computeThreads;
+
+    for (int i = 0; i < m_cfg.ioThreads; ++i)
+        m_threads.push_back(QThread::create([this]() { ioLoop(); }));
+    for (int i = 0; i < m_cfg.decodeThreads; ++i)
+        m_threads.push_back(QThread::create([this]() { decodeLoop(); }));
+    for (int i = 0; i < m_cfg.computeThreads; ++i)
+        m_threads.push_back(QThread::create([this, i]() { computeLoop(i); }));
+
+    for (QThread* t : m_threads) t->start();
+}
+
+void FramePipeline::cancel()
+{
+    m_rawQueue.abort();
+    m_decodedQueue.abort();
+}
+
+void FramePipeline::wait()
+{
+    for (QThread* t : m_threads) t->wait();
+}
+
+// 进度信号按总帧数的千分之一节流，避免每帧一次跨线程事件
+// 设置了 FrameSink 时结束标记由它发出（如滞后帧对全部完成后）
+void FramePipeline::frameDone(int index, FrameContext* frame)
+{
+    if (m_sink) m_sink->addFrame(index, frame, m_collector);
+    else if (m_collector) m_collector->frameDone(index);
+    const int done = ++m_framesDone;
+    const int step = std::max(1, static_cast<int>(m_sources.size()) / 1000);
+    if (done % step == 0 || done == m_sources.size()) emit progress(done);
+}
+
+// 取消时上游线程可能晚于计算线程退出，finished() 必须由最后一个退出的线程发出
+void FramePipeline::threadExited()
+{
+    if (--m_threadsAlive == 0) emit finished();
+}
+
+// 读取阶段：各线程从共享游标领取下一个区段，逐帧映射后逐页预读，缺页等待留在 I/O 线程。
+// 多帧文件的映射在打开时已建立，这里只预读目标帧所在的页
+void FramePipeline::ioLoop()
+{
+    const int total = m_sources.size();
+    bool stop = false;
+    while (!stop) {
+        const int begin = m_nextChunk.fetch_add(1) * m_chunkFrames;
+        if (begin >= total) break;
+        const int end = std::min(total, begin + m_chunkFrames);
+
+        for (int index = begin; index < end; ++index) {
+            if (cancelled()) { stop = true; break; }
+            if (index < static_cast<int>(m_skip.size()) && m_skip[index]) { frameDone(index); continue; }
+
+            const FrameSource& src = m_sources[index];
+            RawFrame raw{index, src.stack ? src.stack->file() : ImageIO::MappedFile::open(src.path)};
+            if (!raw.file) { frameDone(index); continue; }
+            if (src.stack) src.stack->prefetch(src.frame, m_roi);
+            else ImageIO::prefetch(*raw.file, m_roi);
+            if (!m_rawQueue.push(std::move(raw))) { stop = true; break; }
+        }
+    }
+    // 最后一个读取线程退出时通知下游：不会再有新数据
+    if (--m_ioAlive == 0) m_rawQueue.close();
+    threadExited();
+}
+
+// 解码阶段：只解码 ROI 覆盖的区域；未压缩格式直接引用映射区
+void FramePipeline::decodeLoop()
+{
+    RawFrame raw;
+    while (m_rawQueue.pop(raw)) {
+        const FrameSource& src = m_sources[raw.index];
+        DecodedFrame decoded{raw.index, cv::Mat(), nullptr};
+        try {
+            decoded.img = src.stack ? src.stack->decode(src.frame, m_roi) : ImageIO::decode(*raw.file, m_roi);
+            if (!decoded.img.empty() && raw.file->contains(decoded.img.data)) decoded.source = raw.file;
+        }
+        catch (const std::exception& e) {
+            qDebug() << "DecodeError:" << src.label << e.what();
+        }
+
+        if (decoded.img.empty()) { frameDone(raw.index); continue; }
+        if (!m_decodedQueue.push(ownerOf(raw.index), std::move(decoded))) break;
+    }
+    if (--m_decodeAlive == 0) m_decodedQueue.close();
+    threadExited();
+}
+
+// 计算阶段：每帧的全部输出在此上报
+void FramePipeline::computeLoop(int worker)
+{
+    // 帧预处理与相关计算在本线程选定的后端上执行，GLCM 相位谱在 FrameProcessor 内另行切换
+    Backend::Scope backend(Backend::Stage::Correlation);
+    const std::atomic<bool>* flag = m_pCancelled.get();
+
+    DecodedFrame frame;
+    QVector<QPair<int, double>> results;
+    QVector<QPair<int, cv::Mat>> maps;
+    QVector<QPair<int, cv::Mat>>* mapsOut = m_collector && m_collector->wantsMaps() ? &maps : nullptr;
+    while (m_decodedQueue.pop(worker, frame)) {
+        const QString& label = m_sources[frame.index].label;
+        results.clear();
+        maps.clear();
+        // 整幅图的中间量在帧对相关中复用，生命周期延续到 frameDone
+        FrameContext ctx(frame.img);
+        try {
+            if (m_processor) m_processor->process(ctx, results, flag, mapsOut);
+        }
+        catch (const std::exception& e) {
+            qDebug() << "TaskError:" << label << e.what();
+        }
+        catch (...) {
+        }
+
+        if (m_collector) {
+            // 结果图先于标量落盘，检查点登记该帧时其结果图已写出
+            for (const auto& m : maps) m_collector->pushMap(frame.index, m.first, m.second);
+            for (const auto& r : results) m_collector->push(frame.index, r.first, r.second);
+        }
+        frameDone(frame.index, &ctx);
+        frame.img.release();
+        frame.source.reset();
+    }
+
+    threadExited();
+}
@@ -0,0 +1,295 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <QObject>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QStringList>
+#include <QVector>
+#include <deque>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "task.h"
+#include "ImageIO.h"
+
+/**
+ * @brief 有界阻塞队列
+ * 队列满时 push 阻塞（向上游施加背压），队列空时 pop 阻塞。
+ * close() 表示生产结束，消费者取完剩余数据后 pop 返回 false；
+ * abort() 用于取消，立即唤醒并放行所有等待者。
+ */
+template<typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(int capacity = 1) : m_capacity(std::max(1, capacity)) {}
+
+    void setCapacity(int capacity) {
+        QMutexLocker locker(&m_mutex);
+        m_capacity = std::max(1, capacity);
+    }
+
+    bool push(T item) {
+        QMutexLocker locker(&m_mutex);
+        while (!m_aborted && !m_closed && static_cast<int>(m_items.size()) >= m_capacity)
+            m_notFull.wait(&m_mutex);
+        if (m_aborted || m_closed) return false;
+        m_items.push_back(std::move(item));
+        m_notEmpty.wakeOne();
+        return true;
+    }
+
+    bool pop(T& item) {
+        QMutexLocker locker(&m_mutex);
+        while (!m_aborted && !m_closed && m_items.empty())
+            m_notEmpty.wait(&m_mutex);
+        if (m_aborted || m_items.empty()) return false;
+        item = std::move(m_items.front());
+        m_items.pop_front();
+        m_notFull.wakeOne();
+        return true;
+    }
+
+    void close() {
+        QMutexLocker locker(&m_mutex);
+        m_closed = true;
+        m_notEmpty.wakeAll();
+        m_notFull.wakeAll();
+    }
+
+    void abort() {
+        QMutexLocker locker(&m_mutex);
+        m_aborted = true;
+        m_items.clear();
+        m_notEmpty.wakeAll();
+        m_notFull.wakeAll();
+    }
+
+private:
+    QMutex m_mutex;
+    QWaitCondition m_notEmpty, m_notFull;
+    std::deque<T> m_items;
+    int m_capacity;
+    bool m_closed = false;
+    bool m_aborted = false;
+};
+
+/**
+ * @brief 有界工作窃取队列
+ * 每个工作线程一条双端队列：生产者按亲和关系放入指定队列，工作线程从自己队列的头部取，
+ * 自己的队列空了再从其他队列的尾部窃取。各队列各自加锁，工作线程平时只碰自己的锁；
+ * 全局锁仅用于全空 / 全满时的休眠与唤醒。close() / abort() 语义同 BoundedQueue。
+ */
+template<typename T>
+class WorkStealingQueue {
+public:
+    void reset(int workers, int capacity) {
+        m_workers = std::max(1, workers);
+        m_lanes = std::make_unique<Lane[]>(m_workers);
+        m_capacity = std::max(1, capacity);
+        m_count = 0;
+        m_closed = m_aborted = false;
+    }
+
+    int workers() const { return m_workers; }
+
+    bool push(int worker, T item) {
+        {
+            QMutexLocker locker(&m_waitMutex);
+            while (!m_aborted && !m_closed && m_count.load() >= m_capacity)
+                m_notFull.wait(&m_waitMutex);
+            if (m_aborted || m_closed) return false;
+        }
+        Lane& lane = m_lanes[worker % m_workers];
+        {
+            QMutexLocker locker(&lane.mutex);
+            lane.items.push_back(std::move(item));
+        }
+        // 先入队再计数：等待者在全局锁下看到计数大于 0 就会重新扫描
+        ++m_count;
+        QMutexLocker locker(&m_waitMutex);
+        m_notEmpty.wakeOne();
+        return true;
+    }
+
+    bool pop(int worker, T& item) {
+        for (;;) {
+            if (m_aborted) return false;
+            if (tryPop(worker, item)) {
+                --m_count;
+                QMutexLocker locker(&m_waitMutex);
+                m_notFull.wakeOne();
+                return true;
+            }
+            QMutexLocker locker(&m_waitMutex);
+            if (m_aborted) return false;
+            if (m_count.load() > 0) continue;
+            if (m_closed) return false;
+            m_notEmpty.wait(&m_waitMutex);
+        }
+    }
+
+    void close() {
+        QMutexLocker locker(&m_waitMutex);
+        m_closed = true;
+        m_notEmpty.wakeAll();
+        m_notFull.wakeAll();
+    }
+
+    void abort() {
+        QMutexLocker locker(&m_waitMutex);
+        m_aborted = true;
+        for (int i = 0; i < m_workers; ++i) {
+            QMutexLocker laneLocker(&m_lanes[i].mutex);
+            m_lanes[i].items.clear();
+        }
+        m_notEmpty.wakeAll();
+        m_notFull.wakeAll();
+    }
+
+private:
+    struct alignas(64) Lane {
+        QMutex mutex;
+        std::deque<T> items;
+    };
+
+    bool tryPop(int worker, T& item) {
+        const int self = worker % m_workers;
+        {
+            Lane& own = m_lanes[self];
+            QMutexLocker locker(&own.mutex);
+            if (!own.items.empty()) {
+                item = std::move(own.items.front());
+                own.items.pop_front();
+                return true;
+            }
+        }
+        // 窃取尾部：留给原属线程的是它即将处理的帧
+        for (int k = 1; k < m_workers; ++k) {
+            Lane& victim = m_lanes[(self + k) % m_workers];
+            QMutexLocker locker(&victim.mutex);
+            if (!victim.items.empty()) {
+                item = std::move(victim.items.back());
+                victim.items.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    int m_workers = 1;
+    std::unique_ptr<Lane[]> m_lanes = std::make_unique<Lane[]>(1);
+    int m_capacity = 1;
+    std::atomic<int> m_count{0};
+    QMutex m_waitMutex;
+    QWaitCondition m_notEmpty, m_notFull;
+    std::atomic<bool> m_closed{false};
+    std::atomic<bool> m_aborted{false};
+};
+
+/**
+ * @brief 逐帧中间量的消费者
+ * 计算阶段处理完一帧后调用 addFrame，frame 为该帧整个 ROI 的 FrameContext；
+ * 读取 / 解码失败或跳过的帧 frame 为空。设置后帧结束标记改由消费者向 collector 发出。
+ */
+class FrameSink {
+public:
+    virtual ~FrameSink() = default;
+    virtual void addFrame(int index, FrameContext* frame, ResultCollector* collector) = 0;
+};
+
+// 一帧输入：单帧文件，或多帧文件中的第 frame 帧（stack 非空）
+struct FrameSource {
+    QString path;
+    QString label;      // 结果中的帧标识：文件名，多帧文件为 "文件名#帧序号"
+    std::shared_ptr<const ImageIO::FrameStack> stack;
+    int frame = 0;
+};
+
+// 读取阶段的产物：已映射并预读入页缓存的文件
+struct RawFrame {
+    int index = -1;
+    std::shared_ptr<ImageIO::MappedFile> file;
+};
+
+// 解码阶段的产物：已裁切 ROI 的灰度图
+// 未压缩格式的 img 可能直接引用映射区，source 保证映射在计算结束前不被释放
+struct DecodedFrame {
+    int index = -1;
+    cv::Mat img;
+    std::shared_ptr<ImageIO::MappedFile> source;
+};
+
+/**
+ * @brief 读取 → 解码 → 计算 三级流水线
+ * 专用 I/O 线程预读文件字节，解码线程负责 imdecode 与 ROI 裁切，计算线程执行 FrameProcessor；
+ * 阶段之间以有界队列相连，驻留内存的帧数上限与目录大小无关，磁盘等待与计算相互重叠。
+ * 工作单元是连续帧区段：I/O 线程按区段领取（同一文件 / 相邻文件顺序读），区段的帧进入
+ * 其所属计算线程的队列；便宜帧（MSV）与昂贵帧（GLCM）造成的不均由空闲线程窃取抹平。
+ */
+class FramePipeline : public QObject {
+    Q_OBJECT
+public:
+    FramePipeline(QVector<FrameSource> sources, std::shared_ptr<const FrameProcessor> processor,
+                  const PipelineConfig& cfg, QObject* parent = nullptr);
+
+    // 将输入文件展开为帧：多页 TIFF / DIPRAW 按帧展开，共享同一映射
+    static QVector<FrameSource> expandSources(const QStringList& paths);
+    ~FramePipeline();
+
+    void setROI(cv::Rect roi) { m_roi = roi; }
+    void setPCancelled(std::shared_ptr<std::atomic<bool>> pFlag) { m_pCancelled = pFlag; }
+    // 计算线程直接向收集器提交结果，不经过事件循环
+    void setResultCollector(ResultCollector* collector) { m_collector = collector; }
+    // 按帧序号标记无需计算的帧（续写时已完成），这些帧不读盘，直接记为完成
+    void setSkipFrames(std::vector<char> skip) { m_skip = std::move(skip); }
+    // 每帧计算后交给 sink（滞后帧对相关、双时间矩阵特征等）；processor 可为空，此时只做预处理
+    void setFrameSink(std::shared_ptr<FrameSink> sink) { m_sink = std::move(sink); }
+
+    void start();
+    // 取消：放行所有阻塞在队列上的线程，未进入计算的帧不再上报
+    void cancel();
+    // 等待所有阶段线程退出
+    void wait();
+
+signals:
+    void progress(int done); // 已完成帧数，按约千分之一的粒度节流
+    void finished();         // 所有阶段结束
+
+private:
+    void ioLoop();
+    void decodeLoop();
+    void computeLoop(int worker);
+    // 帧所属的工作线程：同一区段的帧交给同一线程
+    int ownerOf(int index) const { return (index / m_chunkFrames) % m_cfg.computeThreads; }
+    bool cancelled() const { return m_pCancelled && m_pCancelled->load(); }
+    // frame 为该帧的中间量，读取 / 解码失败或跳过的帧为空
+    void frameDone(int index, FrameContext* frame = nullptr);
+    void threadExited();
+
+    QVector<FrameSource> m_sources;
+    std::shared_ptr<const FrameProcessor> m_processor;
+    PipelineConfig m_cfg;
+    cv::Rect m_roi;
+    std::shared_ptr<std::atomic<bool>> m_pCancelled;
+    ResultCollector* m_collector = nullptr;
+    std::vector<char> m_skip;
+    std::shared_ptr<FrameSink> m_sink;
+
+    BoundedQueue<RawFrame> m_rawQueue;
+    WorkStealingQueue<DecodedFrame> m_decodedQueue;
+
+    int m_chunkFrames = 1;                 // 工作单元：连续帧区段的长度
+    std::atomic<int> m_nextChunk{0};
+    std::atomic<int> m_ioAlive{0};
+    std::atomic<int> m_decodeAlive{0};
+    std::atomic<int> m_threadsAlive{0};
+    std::atomic<int> m_framesDone{0};
+
+    std::vector<QThread*> m_threads;
+};
+
+#endif // PIPELINE_H
@@ -0,0 +1,80 @@
+#ifndef RESULTCHANNEL_H
+#define RESULTCHANNEL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// 计算线程上报的一条结果：帧序号与输出序号在会话开始时登记，记录本身不含字符串
+struct ResultRecord {
+    int32_t frame;
+    int32_t output;
+    double value;
+};
+
+// 帧结束标记：output 取此值的记录表示该帧的全部结果已提交（含读取或解码失败的帧）
+constexpr int32_t kFrameDoneOutput = -1;
+
+/**
+ * @brief 有界无锁多生产者单消费者队列
+ * 每个槽位带序号（Vyukov 有界队列）：生产者以 CAS 抢占写入位置，消费者按序号判断槽位是否已写完。
+ * 生产者之间只竞争一个原子计数器，不经过互斥锁与事件循环。
+ */
+template<typename T>
+class MpscQueue {
+public:
+    explicit MpscQueue(size_t capacityPow2 = size_t(1) << 16)
+        : m_mask(capacityPow2 - 1), m_cells(new Cell[capacityPow2])
+    {
+        for (size_t i = 0; i < capacityPow2; ++i) m_cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    // 队列满时返回 false
+    bool tryPush(const T& item) {
+        size_t pos = m_enqueue.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = m_cells[pos & m_mask];
+            const size_t seq = cell.seq.load(std::memory_order_acquire);
+            const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (m_enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.data = item;
+                    cell.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_enqueue.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // 仅消费者线程调用；队列空时返回 false
+    bool tryPop(T& item) {
+        Cell& cell = m_cells[m_dequeue & m_mask];
+        const size_t seq = cell.seq.load(std::memory_order_acquire);
+        if (static_cast<intptr_t>(seq) - static_cast<intptr_t>(m_dequeue + 1) < 0) return false;
+        item = cell.data;
+        cell.seq.store(m_dequeue + m_mask + 1, std::memory_order_release);
+        ++m_dequeue;
+        return true;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> seq;
+        T data;
+    };
+
+    const size_t m_mask;
+    std::unique_ptr<Cell[]> m_cells;
+    alignas(64) std::atomic<size_t> m_enqueue{0};
+    alignas(64) size_t m_dequeue = 0;
+};
+
+#endif // RESULTCHANNEL_H
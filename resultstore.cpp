@@ -0,0 +1,483 @@
+#include "resultstore.h"
+#include <QtEndian>
+#include <QSysInfo>
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace ResultStore {
+
+namespace {
+
+constexpr char kMagic[8] = {'D', 'I', 'P', 'R', 'E', 'S', '0', '1'};
+constexpr char kMapMagic[8] = {'D', 'I', 'P', 'M', 'A', 'P', '0', '1'};
+constexpr char kMatrixMagic[8] = {'D', 'I', 'P', 'M', 'A', 'T', '0', '1'};
+constexpr qint64 kHeaderSize = 64;
+constexpr qint64 kDataAlign = 4096;
+// 列缓冲累积的帧数，每列一次写出 512 KiB
+constexpr size_t kChunkFrames = 1 << 16;
+constexpr bool kHostBigEndian = QSysInfo::ByteOrder == QSysInfo::BigEndian;
+
+template<typename T>
+void appendLE(QByteArray& out, T v)
+{
+    const T le = qToLittleEndian(v);
+    out.append(reinterpret_cast<const char*>(&le), sizeof(T));
+}
+
+template<typename T>
+T readLE(const uchar* p)
+{
+    return qFromLittleEndian<T>(p);
+}
+
+}
+
+/********
+ *Writer*
+ ********/
+bool Writer::open(const QString& path, const QVector<QString>& columns, const std::vector<QByteArray>& labels,
+                  bool resume)
+{
+    m_columns = columns.size();
+    m_frames = static_cast<qint64>(labels.size());
+    m_pending.clear();
+    m_next = 0;
+    m_bufferStart = 0;
+    m_colBuf.assign(m_columns, {});
+    m_keepBuf.clear();
+    m_resumed = false;
+
+    // 列名表与帧表在会话开始时即可确定，一次写出
+    QByteArray names;
+    for (const QString& name : columns) {
+        const QByteArray utf8 = name.toUtf8();
+        appendLE<quint32>(names, static_cast<quint32>(utf8.size()));
+        names.append(utf8);
+    }
+    QByteArray offsets, blob;
+    offsets.reserve((m_frames + 1) * 8);
+    for (const QByteArray& label : labels) {
+        appendLE<quint64>(offsets, static_cast<quint64>(blob.size()));
+        blob.append(label);
+    }
+    appendLE<quint64>(offsets, static_cast<quint64>(blob.size()));
+
+    const qint64 namesOffset = kHeaderSize;
+    const qint64 labelsOffset = namesOffset + names.size();
+    const qint64 labelsEnd = labelsOffset + offsets.size() + blob.size();
+    m_dataOffset = (labelsEnd + kDataAlign - 1) / kDataAlign * kDataAlign;
+
+    QByteArray header;
+    header.append(kMagic, sizeof(kMagic));
+    appendLE<quint32>(header, static_cast<quint32>(m_columns));
+    appendLE<quint32>(header, 0);
+    appendLE<quint64>(header, static_cast<quint64>(m_frames));
+    appendLE<quint64>(header, static_cast<quint64>(namesOffset));
+    appendLE<quint64>(header, static_cast<quint64>(labelsOffset));
+    appendLE<quint64>(header, static_cast<quint64>(m_dataOffset));
+    header.append(kHeaderSize - header.size(), '\0');
+
+    m_file.setFileName(path);
+    const qint64 totalSize = m_dataOffset + qint64(m_columns) * m_frames * 8;
+    if (resume && m_file.size() == totalSize && m_file.open(QIODevice::ReadWrite)) {
+        // 头部、列名表与帧表逐字节一致才沿用已有数据
+        const QByteArray existing = m_file.read(labelsEnd);
+        if (existing == header + names + offsets + blob) {
+            m_resumed = true;
+            return true;
+        }
+        m_file.close();
+    }
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qDebug() << "Failed to open result store:" << path;
+        return false;
+    }
+    m_file.write(header);
+    m_file.write(names);
+    m_file.write(offsets);
+    m_file.write(blob);
+    // 预留整个数据区，之后各列按帧序分段写入
+    m_file.resize(totalSize);
+    return true;
+}
+
+Writer::Row& Writer::row(int frame)
+{
+    Row& r = m_pending[frame];
+    if (r.values.empty()) r.values.assign(m_columns, std::numeric_limits<double>::quiet_NaN());
+    return r;
+}
+
+void Writer::add(const ResultRecord& rec)
+{
+    if (!isOpen() || rec.frame < m_next || rec.frame >= m_frames) return;
+    if (rec.output < 0 || rec.output >= m_columns) return;
+    row(rec.frame).values[rec.output] = rec.value;
+}
+
+void Writer::frameDone(int frame, bool keep)
+{
+    if (!isOpen() || frame < m_next || frame >= m_frames) return;
+    Row& r = row(frame);
+    r.done = true;
+    r.keep = keep;
+
+    // 重排缓冲：只有从 m_next 起连续完成的帧才写出
+    for (auto it = m_pending.begin(); it != m_pending.end() && it->first == m_next && it->second.done;
+         it = m_pending.erase(it)) {
+        commit(&it->second.values, it->second.keep);
+    }
+}
+
+void Writer::commit(const std::vector<double>* values, bool keep)
+{
+    for (int c = 0; c < m_columns; ++c)
+        m_colBuf[c].push_back(values ? (*values)[c] : std::numeric_limits<double>::quiet_NaN());
+    m_keepBuf.push_back(keep && m_resumed);
+    ++m_next;
+    if (m_colBuf.empty() || m_colBuf[0].size() >= kChunkFrames) flushColumns();
+}
+
+void Writer::flushColumns()
+{
+    const size_t count = m_colBuf.empty() ? 0 : m_colBuf[0].size();
+    if (count == 0) { m_bufferStart = m_next; m_keepBuf.clear(); return; }
+    const bool merge = std::find(m_keepBuf.begin(), m_keepBuf.end(), 1) != m_keepBuf.end();
+    std::vector<double> existing;
+    for (int c = 0; c < m_columns; ++c) {
+        std::vector<double>& buf = m_colBuf[c];
+        const qint64 pos = m_dataOffset + (qint64(c) * m_frames + m_bufferStart) * 8;
+        if (merge) {
+            // 续写时跳过的帧保留文件中的值：整段读回后只覆盖本次计算的帧
+            existing.resize(buf.size());
+            m_file.seek(pos);
+            m_file.read(reinterpret_cast<char*>(existing.data()), qint64(existing.size()) * 8);
+            for (size_t i = 0; i < buf.size(); ++i) {
+                if (m_keepBuf[i]) buf[i] = qFromLittleEndian(existing[i]);
+            }
+        }
+        if constexpr (kHostBigEndian) {
+            for (double& v : buf) {
+                quint64 bits;
+                std::memcpy(&bits, &v, 8);
+                bits = qToLittleEndian(bits);
+                std::memcpy(&v, &bits, 8);
+            }
+        }
+        m_file.seek(pos);
+        m_file.write(reinterpret_cast<const char*>(buf.data()), qint64(buf.size()) * 8);
+        buf.clear();
+    }
+    m_keepBuf.clear();
+    m_bufferStart = m_next;
+}
+
+void Writer::flush()
+{
+    if (!isOpen()) return;
+    flushColumns();
+    m_file.flush();
+}
+
+void Writer::close()
+{
+    if (!isOpen()) return;
+    // 取消或失败留下的空缺以 NaN 补齐，已到达的部分结果保留。
+    // 续写时从未收到的帧保留文件中的值：跳过的帧的结束标记可能在取消时尚未取出，
+    // 清单仍记其完成，不能被 NaN 覆盖；其余空缺在首次运行关闭时已是 NaN
+    while (m_next < m_frames) {
+        auto it = m_pending.find(m_next);
+        if (it != m_pending.end()) {
+            commit(&it->second.values, it->second.done && it->second.keep);
+            m_pending.erase(it);
+        } else {
+            commit(nullptr, true);
+        }
+    }
+    flushColumns();
+    m_pending.clear();
+    m_file.flush();
+    m_file.close();
+}
+
+/********
+ *Reader*
+ ********/
+bool Reader::open(const QString& path)
+{
+    close();
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::ReadOnly)) return false;
+    m_size = m_file.size();
+    if (m_size < kHeaderSize) { close(); return false; }
+    m_map = m_file.map(0, m_size);
+    if (!m_map || std::memcmp(m_map, kMagic, sizeof(kMagic)) != 0) { close(); return false; }
+
+    m_columns = static_cast<int>(readLE<quint32>(m_map + 8));
+    m_frames = static_cast<qint64>(readLE<quint64>(m_map + 16));
+    const qint64 namesOffset = static_cast<qint64>(readLE<quint64>(m_map + 24));
+    m_labelsOffset = static_cast<qint64>(readLE<quint64>(m_map + 32));
+    m_dataOffset = static_cast<qint64>(readLE<quint64>(m_map + 40));
+    if (m_columns < 0 || m_frames < 0 || m_dataOffset % 8 != 0
+        || m_dataOffset + qint64(m_columns) * m_frames * 8 > m_size
+        || m_labelsOffset + (m_frames + 1) * 8 > m_dataOffset) {
+        close();
+        return false;
+    }
+
+    qint64 pos = namesOffset;
+    for (int c = 0; c < m_columns; ++c) {
+        if (pos + 4 > m_labelsOffset) { close(); return false; }
+        const quint32 len = readLE<quint32>(m_map + pos);
+        pos += 4;
+        if (pos + len > m_labelsOffset) { close(); return false; }
+        m_names.append(QString::fromUtf8(reinterpret_cast<const char*>(m_map + pos), len));
+        pos += len;
+    }
+    return true;
+}
+
+void Reader::close()
+{
+    if (m_map) m_file.unmap(const_cast<uchar*>(m_map));
+    m_map = nullptr;
+    m_file.close();
+    m_size = 0;
+    m_columns = 0;
+    m_frames = 0;
+    m_names.clear();
+}
+
+QString Reader::frameLabel(qint64 frame) const
+{
+    if (!m_map || frame < 0 || frame >= m_frames) return QString();
+    const uchar* offsets = m_map + m_labelsOffset;
+    const qint64 blob = m_labelsOffset + (m_frames + 1) * 8;
+    const quint64 begin = readLE<quint64>(offsets + frame * 8);
+    const quint64 end = readLE<quint64>(offsets + (frame + 1) * 8);
+    if (end < begin || blob + qint64(end) > m_dataOffset) return QString();
+    return QString::fromUtf8(reinterpret_cast<const char*>(m_map + blob + begin), qint64(end - begin));
+}
+
+const double* Reader::column(int c) const
+{
+    if (!m_map || c < 0 || c >= m_columns) return nullptr;
+    return reinterpret_cast<const double*>(m_map + m_dataOffset + qint64(c) * m_frames * 8);
+}
+
+/***********
+ *MapWriter*
+ ***********/
+bool MapWriter::open(const QString& path, qint64 frames, cv::Size size, bool resume)
+{
+    QMutexLocker locker(&m_mutex);
+    m_frames = frames;
+    m_size = size;
+    m_dataOffset = (kHeaderSize + frames + kDataAlign - 1) / kDataAlign * kDataAlign;
+
+    QByteArray header;
+    header.append(kMapMagic, sizeof(kMapMagic));
+    appendLE<quint32>(header, static_cast<quint32>(size.height));
+    appendLE<quint32>(header, static_cast<quint32>(size.width));
+    appendLE<quint64>(header, static_cast<quint64>(frames));
+    appendLE<quint64>(header, static_cast<quint64>(m_dataOffset));
+    header.append(kHeaderSize - header.size(), '\0');
+
+    m_file.setFileName(path);
+    const qint64 totalSize = m_dataOffset + frames * qint64(size.area()) * 4;
+    if (resume && m_file.size() == totalSize && m_file.open(QIODevice::ReadWrite)) {
+        if (m_file.read(kHeaderSize) == header) return true;
+        m_file.close();
+    }
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qDebug() << "Failed to open map file:" << path;
+        return false;
+    }
+    m_file.write(header);
+    // 有效标记与数据区由 resize 置零
+    m_file.resize(totalSize);
+    return true;
+}
+
+bool MapWriter::write(int frame, const cv::Mat& map)
+{
+    if (frame < 0 || frame >= m_frames || map.type() != CV_32F || map.size() != m_size) return false;
+    cv::Mat data = map.isContinuous() ? map : map.clone();
+    if constexpr (kHostBigEndian) {
+        data = data.clone();
+        for (quint32* p = data.ptr<quint32>(), *end = p + data.total(); p != end; ++p) *p = qToLittleEndian(*p);
+    }
+
+    QMutexLocker locker(&m_mutex);
+    if (!m_file.isOpen()) return false;
+    // 先写数据再置有效标记，中途崩溃时不会出现标记有效而数据残缺的帧
+    m_file.seek(m_dataOffset + qint64(frame) * qint64(m_size.area()) * 4);
+    if (m_file.write(reinterpret_cast<const char*>(data.data), qint64(data.total()) * 4) != qint64(data.total()) * 4)
+        return false;
+    m_file.seek(kHeaderSize + frame);
+    m_file.write("\1", 1);
+    return true;
+}
+
+void MapWriter::flush()
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_file.isOpen()) m_file.flush();
+}
+
+void MapWriter::close()
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_file.isOpen()) return;
+    m_file.flush();
+    m_file.close();
+}
+
+/***********
+ *MapReader*
+ ***********/
+bool MapReader::open(const QString& path)
+{
+    close();
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::ReadOnly) || m_file.size() < kHeaderSize) { close(); return false; }
+    const qint64 fileSize = m_file.size();
+    m_map = m_file.map(0, fileSize);
+    if (!m_map || std::memcmp(m_map, kMapMagic, sizeof(kMapMagic)) != 0) { close(); return false; }
+
+    m_size = cv::Size(static_cast<int>(readLE<quint32>(m_map + 12)), static_cast<int>(readLE<quint32>(m_map + 8)));
+    m_frames = static_cast<qint64>(readLE<quint64>(m_map + 16));
+    m_dataOffset = static_cast<qint64>(readLE<quint64>(m_map + 24));
+    if (m_frames < 0 || m_dataOffset % 4 != 0 || kHeaderSize + m_frames > m_dataOffset
+        || m_dataOffset + m_frames * qint64(m_size.area()) * 4 > fileSize) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MapReader::close()
+{
+    if (m_map) m_file.unmap(const_cast<uchar*>(m_map));
+    m_map = nullptr;
+    m_file.close();
+    m_size = cv::Size();
+    m_frames = 0;
+}
+
+bool MapReader::hasFrame(qint64 frame) const
+{
+    return m_map && frame >= 0 && frame < m_frames && m_map[kHeaderSize + frame] != 0;
+}
+
+cv::Mat MapReader::frame(qint64 frame) const
+{
+    if (!hasFrame(frame)) return cv::Mat();
+    uchar* p = const_cast<uchar*>(m_map + m_dataOffset + frame * qint64(m_size.area()) * 4);
+    return cv::Mat(m_size, CV_32F, p);
+}
+
+cv::Mat MapReader::frames(qint64 first, qint64 count) const
+{
+    if (!m_map || first < 0 || count <= 0 || first + count > m_frames || m_size.area() == 0) return cv::Mat();
+    uchar* p = const_cast<uchar*>(m_map + m_dataOffset + first * qint64(m_size.area()) * 4);
+    return cv::Mat(static_cast<int>(count), m_size.area(), CV_32F, p);
+}
+
+/**************
+ *MatrixWriter*
+ **************/
+bool MatrixWriter::open(const QString& path, qint64 rows, qint64 cols)
+{
+    close();
+    if (rows < 0 || cols < 0 || cols > std::numeric_limits<int>::max()) return false;
+    m_rows = rows;
+    m_cols = cols;
+    m_dataOffset = kDataAlign;
+
+    QByteArray header;
+    header.append(kMatrixMagic, sizeof(kMatrixMagic));
+    appendLE<quint64>(header, static_cast<quint64>(rows));
+    appendLE<quint64>(header, static_cast<quint64>(cols));
+    appendLE<quint64>(header, static_cast<quint64>(m_dataOffset));
+    header.append(kHeaderSize - header.size(), '\0');
+
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::ReadWrite | QIODevice::Truncate)) {
+        qDebug() << "Failed to open matrix file:" << path;
+        return false;
+    }
+    const qint64 totalSize = m_dataOffset + rows * cols * 4;
+    m_file.write(header);
+    if (!m_file.resize(totalSize) || !(m_map = m_file.map(0, totalSize))) {
+        qDebug() << "Failed to map matrix file:" << path << m_file.errorString();
+        m_file.close();
+        return false;
+    }
+    return true;
+}
+
+bool MatrixWriter::writeBlock(qint64 row, qint64 col, const cv::Mat& block)
+{
+    if (!m_map || block.type() != CV_32F || row < 0 || col < 0
+        || row + block.rows > m_rows || col + block.cols > m_cols) return false;
+    for (int r = 0; r < block.rows; ++r) {
+        float* dst = reinterpret_cast<float*>(m_map + m_dataOffset + ((row + r) * m_cols + col) * 4);
+        const float* src = block.ptr<float>(r);
+        if constexpr (kHostBigEndian) {
+            for (int c = 0; c < block.cols; ++c) qToLittleEndian<float>(src[c], dst + c);
+        } else {
+            std::memcpy(dst, src, size_t(block.cols) * 4);
+        }
+    }
+    return true;
+}
+
+void MatrixWriter::close()
+{
+    if (m_map) m_file.unmap(m_map);
+    m_map = nullptr;
+    if (m_file.isOpen()) m_file.close();
+}
+
+/**************
+ *MatrixReader*
+ **************/
+bool MatrixReader::open(const QString& path)
+{
+    close();
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::ReadOnly) || m_file.size() < kHeaderSize) { close(); return false; }
+    const qint64 fileSize = m_file.size();
+    m_map = m_file.map(0, fileSize);
+    if (!m_map || std::memcmp(m_map, kMatrixMagic, sizeof(kMatrixMagic)) != 0) { close(); return false; }
+
+    m_rows = static_cast<qint64>(readLE<quint64>(m_map + 8));
+    m_cols = static_cast<qint64>(readLE<quint64>(m_map + 16));
+    m_dataOffset = static_cast<qint64>(readLE<quint64>(m_map + 24));
+    if (m_rows < 0 || m_cols < 0 || m_cols > std::numeric_limits<int>::max() || m_dataOffset % 4 != 0
+        || m_dataOffset < kHeaderSize || m_dataOffset + m_rows * m_cols * 4 > fileSize) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MatrixReader::close()
+{
+    if (m_map) m_file.unmap(const_cast<uchar*>(m_map));
+    m_map = nullptr;
+    m_file.close();
+    m_rows = m_cols = 0;
+}
+
+cv::Mat MatrixReader::rowRange(qint64 row, qint64 count) const
+{
+    if (!m_map || row < 0 || count <= 0 || row + count > m_rows || count > std::numeric_limits<int>::max()) return cv::Mat();
+    uchar* p = const_cast<uchar*>(m_map + m_dataOffset + row * m_cols * 4);
+    return cv::Mat(static_cast<int>(count), static_cast<int>(m_cols), CV_32F, p);
+}
+
+}
@@ -0,0 +1,220 @@
+#ifndef RESULTSTORE_H
+#define RESULTSTORE_H
+
+#include <QFile>
+#include <QString>
+#include <QVector>
+#include <QByteArray>
+#include <QMutex>
+#include <map>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "resultchannel.h"
+
+/**
+ * @brief 二进制列式结果文件（.dipres）
+ * 帧表只存一次，每个输出一列定长 float64，按帧序号排列，可整体内存映射后随机访问。
+ * 所有整数与浮点均为小端。未写入的值（帧解码失败、会话被取消）为 NaN。
+ *
+ *   0  char[8] "DIPRES01"
+ *   8  u32     列数 C
+ *  12  u32     保留
+ *  16  u64     帧数 N
+ *  24  u64     列名表偏移：C 个 (u32 长度 + UTF-8 字节)
+ *  32  u64     帧表偏移：u64 偏移[N+1]（相对字符串区起点），其后为 UTF-8 字符串区
+ *  40  u64     数据区偏移（4096 对齐）：第 c 列位于 数据区 + c * N * 8
+ *  48  保留至 64 字节
+ *
+ * 数据区可直接用 numpy.memmap(path, '<f8', offset=数据区偏移, shape=(C, N)) 读取。
+ */
+namespace ResultStore {
+
+/**
+ * @brief 写出端，仅写出线程使用
+ * 乱序到达的帧先进入重排缓冲，凑成从 next 开始的连续区段后按列顺序写盘。
+ */
+class Writer {
+public:
+    // resume 为 true 且已有文件的列名与帧表完全一致时，在原文件上续写，否则新建
+    bool open(const QString& path, const QVector<QString>& columns, const std::vector<QByteArray>& labels,
+              bool resume = false);
+    bool isOpen() const { return m_file.isOpen(); }
+    // 是否在已有文件上续写
+    bool resumed() const { return m_resumed; }
+
+    void add(const ResultRecord& rec);
+    // 该帧全部结果已提交，可进入顺序写出；keep 表示沿用文件中已有的值（续写时跳过的帧）
+    void frameDone(int frame, bool keep = false);
+    // 写出列缓冲并刷盘；此后 [0, committedFrames()) 的帧均已落盘
+    void flush();
+    qint64 committedFrames() const { return m_next; }
+    // 写出剩余缓冲，未完成的帧以 NaN 补齐；续写时从未收到的帧保留原值
+    void close();
+
+private:
+    struct Row {
+        std::vector<double> values;
+        bool done = false;
+        bool keep = false;
+    };
+    Row& row(int frame);
+    void commit(const std::vector<double>* values, bool keep = false);
+    void flushColumns();
+
+    QFile m_file;
+    int m_columns = 0;
+    qint64 m_frames = 0;
+    qint64 m_dataOffset = 0;
+    bool m_resumed = false;
+
+    std::map<int, Row> m_pending;             // 重排缓冲
+    int m_next = 0;                           // 下一个待写出的帧
+    int m_bufferStart = 0;                    // 列缓冲首帧
+    std::vector<std::vector<double>> m_colBuf;
+    std::vector<char> m_keepBuf;              // 列缓冲中各帧是否沿用已有值
+};
+
+/**
+ * @brief 读取端：内存映射整个文件，列数据零拷贝访问
+ */
+class Reader {
+public:
+    bool open(const QString& path);
+    void close();
+
+    int columnCount() const { return m_columns; }
+    qint64 frameCount() const { return m_frames; }
+    const QVector<QString>& columnNames() const { return m_names; }
+    int columnIndex(const QString& name) const { return m_names.indexOf(name); }
+    QString frameLabel(qint64 frame) const;
+
+    // 第 c 列的 N 个值，指向映射区（按本机字节序解释，仅适用于小端主机）
+    const double* column(int c) const;
+    double value(qint64 frame, int c) const { return column(c)[frame]; }
+
+private:
+    QFile m_file;
+    const uchar* m_map = nullptr;
+    qint64 m_size = 0;
+    int m_columns = 0;
+    qint64 m_frames = 0;
+    qint64 m_labelsOffset = 0;
+    qint64 m_dataOffset = 0;
+    QVector<QString> m_names;
+};
+
+/**
+ * @brief 逐帧结果图文件（.dipmap），每个产出结果图的输出一个文件
+ * 帧序号与同一会话的 CSV / results.dipres 的帧表一致；每帧一个定长 float32 槽位，
+ * 未写入的帧有效标记为 0。小端。
+ *
+ *   0  char[8] "DIPMAP01"
+ *   8  u32     行数
+ *  12  u32     列数
+ *  16  u64     帧数 N
+ *  24  u64     数据区偏移（4096 对齐）：第 f 帧位于 数据区 + f * 行数 * 列数 * 4
+ *  32  保留至 64 字节
+ *  64  u8      有效标记[N]
+ *
+ * 数据区可直接用 numpy.memmap(path, '<f4', offset=数据区偏移, shape=(N, 行数, 列数)) 读取。
+ */
+class MapWriter {
+public:
+    // 尺寸在第一帧结果图到达时确定；resume 为 true 且已有文件的尺寸与帧数一致时在原文件上续写
+    bool open(const QString& path, qint64 frames, cv::Size size, bool resume = false);
+    bool isOpen() const { return m_file.isOpen(); }
+    cv::Size size() const { return m_size; }
+
+    // 任意线程调用；map 须为本文件尺寸的 CV_32F
+    bool write(int frame, const cv::Mat& map);
+    // 把已写入的帧交给系统，检查点登记完成位前调用
+    void flush();
+    void close();
+
+private:
+    QMutex m_mutex;
+    QFile m_file;
+    cv::Size m_size;
+    qint64 m_frames = 0;
+    qint64 m_dataOffset = 0;
+};
+
+/**
+ * @brief 结果图读取端：内存映射，按帧零拷贝访问
+ */
+class MapReader {
+public:
+    bool open(const QString& path);
+    void close();
+
+    qint64 frameCount() const { return m_frames; }
+    cv::Size size() const { return m_size; }
+    bool hasFrame(qint64 frame) const;
+    // 第 frame 帧的结果图，引用映射区（只读）；帧未写入时返回空 Mat
+    cv::Mat frame(qint64 frame) const;
+    // 从 first 开始的 count 帧，每帧展平为一行（count × 行数*列数），引用映射区，不检查有效标记
+    cv::Mat frames(qint64 first, qint64 count) const;
+
+private:
+    QFile m_file;
+    const uchar* m_map = nullptr;
+    cv::Size m_size;
+    qint64 m_frames = 0;
+    qint64 m_dataOffset = 0;
+};
+
+/**
+ * @brief 稠密 float32 矩阵文件（.dipmat），行优先，小端
+ *
+ *   0  char[8] "DIPMAT01"
+ *   8  u64     行数
+ *  16  u64     列数
+ *  24  u64     数据区偏移（4096 对齐）
+ *  32  保留至 64 字节
+ *
+ * 数据区可直接用 numpy.memmap(path, '<f4', offset=数据区偏移, shape=(行数, 列数)) 读取。
+ */
+class MatrixWriter {
+public:
+    // 文件按最终大小建立并整体映射，写入直接落在页缓存中，常驻内存不受矩阵大小限制
+    bool open(const QString& path, qint64 rows, qint64 cols);
+    bool isOpen() const { return m_map != nullptr; }
+
+    // 任意线程调用，各线程写入的块互不重叠时无需加锁；block 须为 CV_32F
+    bool writeBlock(qint64 row, qint64 col, const cv::Mat& block);
+    void close();
+
+private:
+    QFile m_file;
+    uchar* m_map = nullptr;
+    qint64 m_rows = 0;
+    qint64 m_cols = 0;
+    qint64 m_dataOffset = 0;
+};
+
+/**
+ * @brief 矩阵读取端：内存映射，零拷贝访问（按本机字节序解释，仅适用于小端主机）
+ */
+class MatrixReader {
+public:
+    bool open(const QString& path);
+    void close();
+
+    qint64 rows() const { return m_rows; }
+    qint64 cols() const { return m_cols; }
+    // 第 row 行起的 count 行，引用映射区（只读）
+    cv::Mat rowRange(qint64 row, qint64 count) const;
+
+private:
+    QFile m_file;
+    const uchar* m_map = nullptr;
+    qint64 m_rows = 0;
+    qint64 m_cols = 0;
+    qint64 m_dataOffset = 0;
+};
+
+}
+
+#endif // RESULTSTORE_H
@@ -1,149 +1,376 @@
 #include "task.h"
-#include <QThreadPool>
+#include "pipeline.h"
+#include "temporal.h"
+#include "backend.h"
+#include "ImageIO.h"
+#include <QFile>
 #include <QFileInfo>
 #include <QDebug>
 #include <QCoreApplication>
-#include <QMessageBox>
+#include <QCryptographicHash>
+#include <QElapsedTimer>
+#include <cstdio>
+#include <algorithm>
+#include <limits>
+#include <map>
 
 #include "ImgPcAlg.h"
 
 // 辅助函数：处理 OpenCV 在 Windows 下的中文路径读取问题
+// 文件经 QFile 映射后直接解码，避开 OpenCV 对文件路径字符串的平台差异处理
 cv::Mat imread_safe(const QString& path)
 {
-    // 1. 使用 QFile 读取二进制数据，Qt 会自动处理各种平台的路径编码（包括 Windows 的 UTF-16）
-    QFile file(path);
-    if (!file.open(QIODevice::ReadOnly)) { return cv::Mat(); }
-
-    QByteArray data = file.readAll();
-    file.close();
-
-    // 2. 将 QByteArray 转换为 std::vector<uchar>
-    std::vector<uchar> buffer(data.begin(), data.end());
+    return ImageIO::readImage(path);
+}
 
-    // 3. 使用 imdecode 从内存中解码图像
-    // 这种方式完全避开了 OpenCV 对文件路径字符串的平台差异处理
-    return cv::imdecode(buffer, cv::IMREAD_GRAYSCALE);
+FrameProcessor::FrameProcessor(QVector<QString> algNames, PreparedAlgs prepared, GLCM::GLCMRequest glcmReq)
+    : FrameProcessor(std::move(algNames), QVector<Region>{{QString(), cv::Rect(), std::move(prepared)}}, std::move(glcmReq))
+{
 }
 
-void ProcessingTask::run()
+FrameProcessor::FrameProcessor(QVector<QString> algNames, QVector<Region> regions, GLCM::GLCMRequest glcmReq)
+    : m_algNames(std::move(algNames)), m_regions(std::move(regions)), m_glcmReq(std::move(glcmReq))
 {
-    if (m_pCancelled && m_pCancelled->load()) {
-        emit resultsSkipped(m_algNames.size());
-        emit finished();
-        return;
+    QString base;
+    int levels = 0;
+    // 附加输出的后缀取自任一区域中构建成功的实例，所有区域的输出布局一致
+    QVector<QStringList> suffixes;
+    for (const QString& algName : m_algNames) {
+        if (GLCM::parseOutputName(algName, m_glcmReq, base, levels)) m_needsGlcm = true;
+        QStringList algSuffixes;
+        for (const Region& region : m_regions) {
+            if (const auto alg = region.prepared.value(algName)) {
+                algSuffixes = alg->auxSuffixes();
+                break;
+            }
+        }
+        m_auxCount.append(algSuffixes.size());
+        suffixes.append(algSuffixes);
+        m_outputsPerRegion += 1 + algSuffixes.size();
     }
 
-    try {
-        cv::Mat fullImg = imread_safe(m_path);
-        if (fullImg.empty()) {
-            emit resultsSkipped(m_algNames.size());
-            emit finished();
-            return;
+    // 输出序号：按区域分块，块内每个算法一个主结果，其后紧跟其附加输出
+    for (const Region& region : m_regions) {
+        const QString tag = region.id.isEmpty() ? QString() : "@" + region.id;
+        for (int a = 0; a < m_algNames.size(); ++a) {
+            m_outputNames.append(m_algNames[a] + tag);
+            for (const QString& suffix : suffixes[a]) m_outputNames.append(m_algNames[a] + suffix + tag);
         }
+    }
+}
 
-        // --- 核心改动：应用 ROI ---
-        cv::Mat img;
-        if (m_roi.width > 0 && m_roi.height > 0) {
-            img = fullImg(m_roi).clone(); // 只处理 ROI 区域
-        } else {
-            img = fullImg;
-        }
-        if (img.empty()) {
-            emit resultsSkipped(m_algNames.size());
-            emit finished();
-            return;
+bool FrameProcessor::process(const cv::Mat& img, QVector<QPair<int, double>>& results,
+                             const std::atomic<bool>* cancelled, QVector<QPair<int, cv::Mat>>* maps) const
+{
+    // 帧级共享中间量：浮点转换、梯度、下采样、范数等被所有算法复用
+    FrameContext frame(img);
+    return process(frame, results, cancelled, maps);
+}
+
+bool FrameProcessor::process(FrameContext& frame, QVector<QPair<int, double>>& results,
+                             const std::atomic<bool>* cancelled, QVector<QPair<int, cv::Mat>>* maps) const
+{
+    const cv::Mat& img = frame.input();
+    const cv::Rect bounds(0, 0, img.cols, img.rows);
+    for (int r = 0; r < m_regions.size(); ++r) {
+        const Region& region = m_regions[r];
+        if (region.rect.empty()) {
+            if (!processRegion(frame, region, r * m_outputsPerRegion, results, cancelled, maps)) return false;
+            continue;
         }
+        // 子区域是解码结果上的视图，不复制像素；帧小于预期时越界的区域本帧无结果
+        if ((region.rect & bounds) != region.rect) continue;
+        FrameContext view(img(region.rect));
+        if (!processRegion(view, region, r * m_outputsPerRegion, results, cancelled, maps)) return false;
+    }
+    return true;
+}
 
-        QString fileName = QFileInfo(m_path).fileName();
+bool FrameProcessor::processRegion(FrameContext& frame, const Region& region, int first, QVector<QPair<int, double>>& results,
+                                   const std::atomic<bool>* cancelled, QVector<QPair<int, cv::Mat>>* maps) const
+{
+    // GLCM 缓存逻辑：相位谱与全部 (灰度级, 偏移) 的共生矩阵每帧只构建一次
+    std::unique_ptr<GLCM::GLCMSet> glcmSet;
+    if (m_needsGlcm) {
+        Backend::Scope backend(Backend::Stage::Spectrum);
+        glcmSet = std::make_unique<GLCM::GLCMSet>(frame.input(), m_glcmReq);
+    }
 
-        // GLCM 缓存逻辑
-        std::shared_ptr<GLCM::GLCmat> sharedGlcm = nullptr;
-        bool needsGlcm = m_algNames.contains(CORRNAME) || m_algNames.contains(HOMONAME);
+    QString glcmBase;
+    int glcmLevels = 0;
+    std::vector<double> aux;
+    int output = first;
+    for (int a = 0; a < m_algNames.size(); ++a) {
+        const QString& algName = m_algNames[a];
+        if (cancelled && cancelled->load()) return false;
+        const int main = output;
+        output += 1 + m_auxCount[a];
+
+        std::shared_ptr<const AlgInterface> alg;
+        // 如果是 GLCM 类算法且有缓存，多个偏移时取方向平均
+        if (glcmSet && GLCM::parseOutputName(algName, m_glcmReq, glcmBase, glcmLevels)) {
+            auto glcms = glcmSet->matrices(glcmLevels);
+            if (glcmBase == CORRNAME) alg = std::make_shared<GLCM::GLCMcorrAlg>(glcms);
+            else alg = std::make_shared<GLCM::GLCMhomoAlg>(glcms);
+        } else {
+            // 普通算法使用会话内预构建的共享实例；该区域参考图无法构建时跳过
+            alg = region.prepared.value(algName);
+        }
 
-        if (needsGlcm) {
-            sharedGlcm = GLCM::getPSGLCM(img, 32, 1, 0);
+        if (alg && maps && alg->hasMap()) {
+            // 结果图与标量汇总一次算出
+            cv::Mat map;
+            results.append({main, alg->processWithMap(frame, map)});
+            if (!map.empty()) maps->append({main, map});
+        } else if (alg) {
+            double val = alg->processWithAux(frame, aux); // 统一调用！
+            results.append({main, val});
+
+            // 附加输出（如 ZNCCshift 的位移）紧随主结果编号，按 "算法名+后缀" 写出
+            const int auxCount = std::min<int>(m_auxCount[a], static_cast<int>(aux.size()));
+            for (int i = 0; i < auxCount; ++i)
+                results.append({main + 1 + i, aux[i]});
         }
+    }
+    return true;
+}
 
-        for (const QString& algName : m_algNames) {
-            if (m_pCancelled && m_pCancelled->load()) break;
+ProcessingSession* TaskManager::createSession()
+{
+    return new ProcessingSession(m_collector);
+}
 
-            std::unique_ptr<AlgInterface> alg;
-            // 如果是 GLCM 类算法且有缓存
-            if ((algName == CORRNAME || algName == HOMONAME) && sharedGlcm) {
-                if (algName == CORRNAME) alg = std::make_unique<GLCM::GLCMcorrAlg>(sharedGlcm);
-                else alg = std::make_unique<GLCM::GLCMhomoAlg>(sharedGlcm);
+PreparedAlgs ProcessingSession::prepareAlgs(const cv::Mat& refImg, QVector<QString>& algs, const GLCM::GLCMRequest& glcmReq)
+{
+    // 参考数据须与逐帧计算处于同一后端，否则每帧都会在主机与设备之间搬运参考梯度
+    Backend::Scope backend(Backend::Stage::Correlation);
+    PreparedAlgs prepared;
+    // 多尺度实例共用参考图的一份金字塔，按需构建
+    std::unique_ptr<FrameContext> ref;
+    for (auto it = algs.begin(); it != algs.end();) {
+        const QString& algName = *it;
+        // GLCM 类算法依赖每帧图像本身，不需要参考图
+        QString base;
+        int levels;
+        if (GLCM::parseOutputName(algName, glcmReq, base, levels)) { ++it; continue; }
+
+        try {
+            std::shared_ptr<const AlgInterface> alg;
+            int f = 1;
+            if (MultiScale::parseOutputName(algName, base, f)) {
+                if (!ref) ref = std::make_unique<FrameContext>(refImg);
+                alg = MultiScale::create(base, *ref, f);
             } else {
-                // 普通算法通过注册机获取
-                alg = AlgRegistry<QString>::instance().get(algName, m_refImg);
+                alg = AlgRegistry<QString>::instance().get(algName, refImg);
             }
-
             if (alg) {
-                double val = alg->process(img); // 统一调用！
-                emit resultReady(algName, fileName, val);
+                prepared.insert(algName, alg);
+                ++it;
+                continue;
             }
+            qDebug() << "Unknown algorithm:" << algName;
+        }
+        catch (const std::exception& e) {
+            qDebug() << "PrepareError:" << algName << e.what();
         }
+        // 参考图无法构建该算法（如参考图过暗），整个会话都不再计算它
+        it = algs.erase(it);
+    }
+    return prepared;
+}
+
+void ProcessingSession::setScales(const QVector<int>& factors)
+{
+    m_scales.clear();
+    for (int f : factors) {
+        if (f > 0 && !m_scales.contains(f)) m_scales.append(f);
     }
-    catch (const std::exception& e) {
-        qDebug() << "TaskError:" << e.what();
-        // QMessageBox::warning(nullptr, "TaskError",
-        //                      tr(e.what()));
-        emit resultsSkipped(m_algNames.size());
+    std::sort(m_scales.begin(), m_scales.end());
+}
+
+void ProcessingSession::setLags(const QVector<int>& lags)
+{
+    // 去重并升序，非正的滞后无意义
+    m_lags.clear();
+    for (int k : lags) {
+        if (k > 0 && !m_lags.contains(k)) m_lags.append(k);
     }
-    catch (...) {
-        emit resultsSkipped(m_algNames.size());
+    std::sort(m_lags.begin(), m_lags.end());
+}
+
+QVector<cv::Rect> ProcessingSession::gridRegions(cv::Size area, cv::Size cell, cv::Size stride)
+{
+    QVector<cv::Rect> regions;
+    if (cell.width <= 0 || cell.height <= 0) return regions;
+    if (stride.width <= 0 || stride.height <= 0) stride = cell;
+    for (int y = 0; y + cell.height <= area.height; y += stride.height) {
+        for (int x = 0; x + cell.width <= area.width; x += stride.width)
+            regions.append(cv::Rect(x, y, cell.width, cell.height));
     }
+    return regions;
+}
 
-    emit finished();
+ProcessingSession::~ProcessingSession()
+{
+    // 流水线析构时会放行并等待全部阶段线程
+    delete m_pipeline;
 }
 
-ProcessingSession* TaskManager::createSession()
+// 会话指纹：参考图、ROI 与子区域、GLCM 请求、输出名与帧表任一不同都视为新会话
+static QByteArray sessionFingerprint(const cv::Mat& refImg, cv::Rect roi, const QVector<cv::Rect>& regions,
+                                     const GLCM::GLCMRequest& glcmReq,
+                                     const QVector<QString>& outputNames, const QStringList& labels,
+                                     const QByteArray& tag)
 {
-    return new ProcessingSession(m_collector);
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    auto addInts = [&hash](std::initializer_list<qint64> values) {
+        for (qint64 v : values) hash.addData(QByteArrayView(reinterpret_cast<const char*>(&v), sizeof(v)));
+    };
+    auto addString = [&hash](const QString& text) {
+        hash.addData(text.toUtf8());
+        hash.addData(QByteArrayView("\0", 1));
+    };
+
+    const cv::Mat ref = refImg.isContinuous() ? refImg : refImg.clone();
+    addInts({ref.rows, ref.cols, ref.type()});
+    hash.addData(QByteArrayView(reinterpret_cast<const char*>(ref.data), qsizetype(ref.total() * ref.elemSize())));
+    addInts({roi.x, roi.y, roi.width, roi.height});
+    for (const cv::Rect& r : regions) addInts({r.x, r.y, r.width, r.height});
+    for (int l : glcmReq.levels) addInts({l});
+    for (const cv::Point& o : glcmReq.offsets) addInts({o.x, o.y});
+    addInts({static_cast<qint64>(glcmReq.strategy)});
+    for (const QString& name : outputNames) addString(name);
+    for (const QString& label : labels) addString(label);
+    hash.addData(tag);
+    return hash.result();
 }
 
-void ProcessingSession::start(const cv::Mat& refImg, const QStringList& files, const QDir& dir, const QVector<QString>& algs)
+void ProcessingSession::start(const cv::Mat& refImg, const QStringList& files, const QDir& dir, const QVector<QString>& selectedAlgs)
 {
-    m_totalTasks = files.size();
+    // 多灰度级时 GLCM 特征按灰度级展开为独立输出
+    // 以本会话的实际帧尺寸测定 auto 阶段的后端，同一尺寸只测一次
+    Backend::autotune(refImg);
+    QVector<QString> algs = GLCM::expandOutputNames(selectedAlgs, m_glcmReq);
+    algs = MultiScale::expandOutputNames(algs, m_scales);
+    std::shared_ptr<const FrameProcessor> processor;
+    if (m_regions.isEmpty()) {
+        const PreparedAlgs prepared = prepareAlgs(refImg, algs, m_glcmReq);
+        processor = std::make_shared<const FrameProcessor>(algs, prepared, m_glcmReq);
+    } else {
+        // 每个子区域的参考数据只构建一次；区域序号固定，越界的区域被丢弃但不影响其余区域的命名
+        QVector<FrameProcessor::Region> regions;
+        QVector<QString> kept;
+        const cv::Rect refBounds(0, 0, refImg.cols, refImg.rows);
+        for (int r = 0; r < m_regions.size(); ++r) {
+            const cv::Rect rect = m_regions[r];
+            if (rect.empty() || (rect & refBounds) != rect) {
+                qDebug() << "Region outside the reference image:" << r;
+                continue;
+            }
+            QVector<QString> regionAlgs = algs;
+            regions.append({QString("R%1").arg(r), rect, prepareAlgs(refImg(rect), regionAlgs, m_glcmReq)});
+            for (const QString& name : regionAlgs) {
+                if (!kept.contains(name)) kept.append(name);
+            }
+        }
+        // 只保留至少在一个区域构建成功的算法，顺序同 algs
+        QVector<QString> ordered;
+        for (const QString& name : algs) {
+            if (kept.contains(name)) ordered.append(name);
+        }
+        algs = ordered;
+        if (!regions.isEmpty()) processor = std::make_shared<const FrameProcessor>(algs, regions, m_glcmReq);
+        else algs.clear();
+    }
+
+    // 多帧文件按帧展开，每帧一个任务
+    QStringList paths;
+    paths.reserve(files.size());
+    for (const QString& fileName : files) paths.append(dir.absoluteFilePath(fileName));
+    QVector<FrameSource> sources = algs.isEmpty() ? QVector<FrameSource>() : FramePipeline::expandSources(paths);
+
+    m_totalTasks = sources.size();
     m_activeTasks = m_totalTasks;
 
-    if (m_totalTasks == 0) {
+    if (m_totalTasks == 0 || m_pCancelled->load()) {
         emit sessionFinished();
         return;
     }
 
-    m_collector->resetExpectedCount(m_totalTasks * algs.size());
-
-    for (const QString& fileName : files) {
-        if(m_pCancelled->load()) {
-            // 补偿未提交任务的计数，确保 activeTasks 最终能归零
-            m_activeTasks--;
-            m_collector->decrementExpectedCount(algs.size());
-            continue;
+    QStringList labels;
+    labels.reserve(sources.size());
+    for (const FrameSource& src : sources) labels.append(src.label);
+
+    // 滞后帧对相关的输出接在固定参考输出之后，作用于整个 ROI
+    QVector<QString> outputNames = processor->outputNames();
+    std::shared_ptr<TemporalCorrelator> temporal;
+    if (!m_lags.isEmpty()) {
+        const bool nipc = selectedAlgs.contains(NIPCNAME);
+        const bool zncc = selectedAlgs.contains(ZNCCNAME);
+        if (nipc || zncc) {
+            temporal = std::make_shared<TemporalCorrelator>(m_lags, nipc, zncc, sources.size(), outputNames.size());
+            outputNames += temporal->outputNames();
+        } else {
+            qDebug() << "Lagged pairs require NIPC or ZNCC";
         }
+    }
+
+    m_collector->beginSession(outputNames, labels,
+                              sessionFingerprint(refImg, roi4Task, m_regions, m_glcmReq, outputNames, labels,
+                                                 m_resumeTag));
 
-        ProcessingTask* task = new ProcessingTask(dir.absoluteFilePath(fileName), algs, refImg);
-        task->setPCancelled(m_pCancelled);
-        task->setROI(roi4Task);
-        connect(task, &ProcessingTask::resultReady, m_collector, &ResultCollector::handleResult);
-        // 如果任务内部失败，也要同步计数
-        connect(task, &ProcessingTask::resultsSkipped, m_collector, &ResultCollector::decrementExpectedCount);
-        connect(task, &ProcessingTask::finished, this, &ProcessingSession::onTaskFinished);
-        QThreadPool::globalInstance()->start(task);
+    // 续写时跳过的帧不再提供中间量：只有其全部后继帧对也被跳过时才能跳过
+    std::vector<char> skip = m_collector->completedFrames();
+    if (temporal) {
+        for (int i = static_cast<int>(skip.size()) - 1; i >= 0; --i) {
+            for (int k : m_lags) {
+                if (skip[i] && i + k < static_cast<int>(skip.size()) && !skip[i + k]) skip[i] = 0;
+            }
+        }
     }
-    if (m_activeTasks <= 0) { emit sessionFinished(); }
+
+    delete m_pipeline;
+    m_pipeline = new FramePipeline(std::move(sources), processor, m_pipelineCfg);
+    m_pipeline->setResultCollector(m_collector);
+    m_pipeline->setSkipFrames(std::move(skip));
+    m_pipeline->setFrameSink(temporal);
+    m_pipeline->setROI(roi4Task);
+    m_pipeline->setPCancelled(m_pCancelled);
+    connect(m_pipeline, &FramePipeline::progress, this, &ProcessingSession::onProgress);
+    connect(m_pipeline, &FramePipeline::finished, this, &ProcessingSession::onPipelineFinished);
+    m_poolBase = BufferPool::stats();
+    m_pipeline->start();
 }
 
-void ProcessingSession::onTaskFinished()
+void ProcessingSession::onProgress(int done)
 {
-    m_activeTasks--;
-    emit progressUpdated(m_totalTasks - m_activeTasks, m_totalTasks);
+    // 各计算线程发出的进度可能乱序到达，只接受更大的值
+    if (done <= m_totalTasks - m_activeTasks) return;
+    m_activeTasks = m_totalTasks - done;
+    emit progressUpdated(done, m_totalTasks);
+}
 
-    if (m_activeTasks <= 0) emit sessionFinished();
+void ProcessingSession::onPipelineFinished()
+{
+    // 写出线程排空后才算完成，此后结果文件已全部落盘
+    m_collector->endSession();
+
+    // 每帧向系统申请的缓冲数：缓冲池生效时首帧之后应接近于零
+    const int done = m_totalTasks - m_activeTasks;
+    if (BufferPool::installed() && done > 0) {
+        const BufferPool::Stats s = BufferPool::stats();
+        qDebug() << "Buffer allocations per frame:" << double(s.allocations - m_poolBase.allocations) / done
+                 << "of" << double(s.requests - m_poolBase.requests) / done << "requests";
+    }
+    BufferPool::trim();
+    m_activeTasks = 0;
+    emit sessionFinished();
 }
 
 void ProcessingSession::cancel()
 {
     if(m_pCancelled) m_pCancelled->store(true);
+    if (m_pipeline) m_pipeline->cancel();
 
     if (m_collector) {
         m_collector->abort(); // 立即强行释放文件句柄
@@ -155,105 +382,242 @@ void ProcessingSession::cancel()
  *****************/
 void ResultCollector::setOutputDir(QString path)
 {
-    QMutexLocker locker(&m_mutex);
     m_outputDir = path;
 }
 
 void ResultCollector::prepare()
 {
-    m_isAborted = false; // <--- 关键：重置幽灵状态
-    m_expectedResults = 0; // 确保计数器也是干净的
-
     closeAll();
-    if (!m_outputDir.isEmpty()) {
-        QDir dir;
-        if (!dir.exists(m_outputDir)) {
-            // if (dir.mkpath(m_outputDir)) {
-            //     qDebug() << "Created output directory:" << m_outputDir;
-            // } else {
-            //     qDebug() << "Critical: Could not create output directory!";
-            // }
-        }
-    }
+    m_isAborted = false; // <--- 关键：重置幽灵状态
 }
 
 void ResultCollector::closeAll()
 {
-    QMutexLocker locker(&m_mutex);
-
-    m_streams.clear();
-
-    for (auto f : m_files) {
-        if (f && f->isOpen()) {
-            f->flush(); // 显式刷盘
-            f->close();
-        }
-    }
-    m_files.clear();
-    // QCoreApplication::processEvents();
+    endSession();
 }
 
 void ResultCollector::abort()
 {
-    QMutexLocker locker(&m_mutex);
+    // 写出线程看到该标志后丢弃剩余记录并尽快关闭文件
     m_isAborted = true;
-    // m_expectedResults = 0; // 清空预期，防止后续 handleResult 继续工作
-    // closeAll();            // 立即关闭所有文件句柄
 }
 
-void ResultCollector::resetExpectedCount(int count)
+void ResultCollector::beginSession(const QVector<QString>& outputNames, const QStringList& frameLabels,
+                                   const QByteArray& fingerprint)
 {
-    QMutexLocker locker(&m_mutex);
-    m_expectedResults = count;
+    endSession();
+    m_outputNames = outputNames;
+    m_labels.clear();
+    m_labels.reserve(frameLabels.size());
+    for (const QString& label : frameLabels) m_labels.push_back(label.toUtf8());
+
+    // 检查点：同一会话的清单存在时接续，否则从空清单开始
+    const qint64 frames = frameLabels.size();
+    m_checkpoint = !fingerprint.isEmpty();
+    m_manifest.reset(outputNames.size(), frames, fingerprint);
+    m_resumed = m_checkpoint && m_resume
+                && m_manifest.load(m_outputDir + "/" + SessionManifest::fileName(), outputNames.size(), frames, fingerprint);
+    // 二进制结果在会话开始时按帧表与输出名预留全部空间；写出线程启动后只由它访问
+    if (m_formats & Binary) m_store.open(m_outputDir + "/results.dipres", m_outputNames, m_labels, m_resumed);
+    m_completed.assign(frames, 0);
+    // 二进制文件无法接续（被删除或改动）时不跳过帧，由本次计算补全；CSV 仍按清单去重
+    if (m_resumed && (!m_store.isOpen() || m_store.resumed())) {
+        for (qint64 f = 0; f < frames; ++f) m_completed[f] = m_manifest.frameComplete(f);
+    }
+
+    m_maps.clear();
+    m_maps.resize(outputNames.size());
+
+    // 上一会话被中止时队列中可能残留记录
+    ResultRecord stale;
+    while (m_queue.tryPop(stale)) {}
+
+    m_closing = false;
+    m_writer = QThread::create([this]() { writerLoop(); });
+    m_writer->start();
 }
 
-void ResultCollector::decrementExpectedCount(int count)
+void ResultCollector::push(int frame, int output, double value)
 {
-    QMutexLocker locker(&m_mutex);
-    m_expectedResults -= count;
-    if (m_expectedResults <= 0) {
-        // 虽然在子线程，但因为是 DirectConnection 或简单计数，我们最好通过信号去通知
-        QMetaObject::invokeMethod(this, "allResultsSaved", Qt::QueuedConnection);
+    const ResultRecord rec{frame, output, value};
+    while (!m_queue.tryPush(rec)) {
+        if (m_isAborted) return;
+        QThread::yieldCurrentThread();
     }
 }
 
-void ResultCollector::handleResult(QString algName, QString fileName, double value)
+void ResultCollector::pushMap(int frame, int output, const cv::Mat& map)
 {
-    QMutexLocker locker(&m_mutex);
+    if (m_isAborted || m_mapScale <= 0 || output < 0 || output >= static_cast<int>(m_maps.size())) return;
+    if (frame < 0 || frame >= static_cast<int>(m_labels.size())) return;
+    cv::Mat out = map;
+    if (m_mapScale > 1) {
+        const cv::Size size(std::max(1, map.cols / m_mapScale), std::max(1, map.rows / m_mapScale));
+        cv::resize(map, out, size, 0, 0, cv::INTER_AREA);
+    }
 
-    if (m_isAborted) {
-        m_expectedResults--;
-        if (m_expectedResults <= 0) emit allResultsSaved();
-        return;
+    ResultStore::MapWriter* writer = nullptr;
+    {
+        QMutexLocker locker(&m_mapMutex);
+        auto& slot = m_maps[output];
+        if (!slot) {
+            // 第一帧结果图决定文件中每帧的尺寸
+            slot = std::make_unique<ResultStore::MapWriter>();
+            slot->open(m_outputDir + "/" + m_outputNames[output] + ".dipmap", static_cast<qint64>(m_labels.size()),
+                       out.size(), m_resumed);
+        }
+        writer = slot.get();
     }
+    if (writer->isOpen() && !writer->write(frame, out))
+        qDebug() << "Map size mismatch:" << m_outputNames[output] << QString::fromUtf8(m_labels[frame]);
+}
 
-    if (!m_streams.contains(algName)) {
-        QString fullPath = m_outputDir + "/" + algName + ".csv"; // 建议用 csv 方便表格打开
-        auto file = QSharedPointer<QFile>::create(fullPath);
+void ResultCollector::endSession()
+{
+    if (!m_writer) return;
+    m_closing = true;
+    m_writer->wait();
+    delete m_writer;
+    m_writer = nullptr;
+    for (auto& map : m_maps) {
+        if (map) map->close();
+    }
+    emit allResultsSaved();
+}
 
+void ResultCollector::writerLoop()
+{
+    // 每个输出一个文件与一块写缓冲，累积到阈值后整块写入
+    constexpr int kFlushBytes = 1 << 20;
+    // 检查点间隔：崩溃后最多重算这段时间内完成的帧
+    constexpr int kCheckpointMs = 2000;
+    struct Output {
+        std::unique_ptr<QFile> file;
+        QByteArray buffer;
+        std::map<int, QByteArray> held;   // 二进制结果尚未落盘的帧的行，按帧号暂存
+        bool failed = false;
+    };
+    std::vector<Output> outputs(m_outputNames.size());
+    const bool csv = m_formats & Csv;
+    const QString manifestPath = m_outputDir + "/" + SessionManifest::fileName();
+
+    auto openOutput = [this](Output& out, int index) {
+        QString fullPath = m_outputDir + "/" + m_outputNames[index] + ".csv"; // 建议用 csv 方便表格打开
+        out.file = std::make_unique<QFile>(fullPath);
+        // 续写时截掉上次检查点之后写入的行，这些帧会重新计算
+        if (m_resumed && out.file->size() > m_manifest.csvLength(index)) out.file->resize(m_manifest.csvLength(index));
         // 使用 Append 模式，并在文件开头写入表头
-        bool isNew = !file->exists();
-        if (file->open(QIODevice::Append | QIODevice::Text)) {
-            m_files[algName] = file;
-            auto stream = QSharedPointer<QTextStream>::create(file.data());
-            if (isNew) *stream << "FileName,Value\n";
-            m_streams[algName] = stream;
-        } else {
-            m_expectedResults--;
+        if (!out.file->open(QIODevice::Append)) {
             qDebug() << "Failed to open output file:" << fullPath;
-            // QMessageBox::warning(nullptr, "fail",
-            //                      tr(info.toLatin1()));
+            out.failed = true;
             return;
         }
+        if (!m_resumed) m_manifest.setCsvLength(index, out.file->size());
+        out.buffer.reserve(kFlushBytes + 256);
+        if (out.file->size() == 0) out.buffer.append("FileName,Value\n");
+    };
+    if (csv) {
+        for (int o = 0; o < static_cast<int>(outputs.size()); ++o) openOutput(outputs[o], o);
     }
 
-    if (m_streams.contains(algName)) {
-        *m_streams[algName] << fileName << "," << QString::number(value, 'f', 6) << "\n";
-        // m_streams[algName]->flush(); // 强制刷盘，防止崩溃丢失数据
+    ResultStore::Writer& store = m_store;
+    // 同时写二进制时，一帧的完成位要等它越过重排缓冲才登记；其 CSV 行在此之前不能写入文件，
+    // 否则检查点记下的 CSV 长度包含未登记帧的行，中断后重算会再追加一遍
+    const bool holdRows = csv && m_checkpoint && store.isOpen();
+
+    // 已写入缓冲、尚未登记到清单的 (帧, 输出)
+    std::vector<std::pair<int, int>> unmarked;
+
+    // 检查点：先让结果落盘，再登记完成位并原子替换清单，清单中的位始终不超前于文件内容
+    auto checkpoint = [&]() {
+        store.flush();
+        // 结果图在帧完成标记入队前写入，此处已取出标记的帧其结果图都已交给 MapWriter
+        {
+            QMutexLocker locker(&m_mapMutex);
+            for (auto& map : m_maps) {
+                if (map) map->flush();
+            }
+        }
+        // 二进制结果只有越过重排缓冲、按帧序写出后才算落盘
+        const qint64 durable = store.isOpen() ? store.committedFrames() : std::numeric_limits<qint64>::max();
+        for (int o = 0; o < static_cast<int>(outputs.size()); ++o) {
+            Output& out = outputs[o];
+            if (!out.file || out.failed) continue;
+            // 只放行已落盘帧的行，CSV 长度与完成位保持一致
+            auto it = out.held.begin();
+            for (; it != out.held.end() && it->first < durable; ++it) out.buffer.append(it->second);
+            out.held.erase(out.held.begin(), it);
+            if (!out.buffer.isEmpty()) out.file->write(out.buffer);
+            out.buffer.clear();
+            out.file->flush();
+            m_manifest.setCsvLength(o, out.file->size());
+        }
+        auto kept = unmarked.begin();
+        for (const auto& mark : unmarked) {
+            if (mark.first < durable) m_manifest.markDone(mark.first, mark.second);
+            else *kept++ = mark;
+        }
+        unmarked.erase(kept, unmarked.end());
+        m_manifest.save(manifestPath);
+    };
+
+    char num[64];
+    auto write = [&](const ResultRecord& rec) {
+        if (rec.frame < 0 || rec.frame >= static_cast<int>(m_labels.size())) return;
+        if (rec.output == kFrameDoneOutput) {
+            store.frameDone(rec.frame, m_completed[rec.frame]);
+            return;
+        }
+        if (rec.output < 0 || rec.output >= static_cast<int>(outputs.size())) return;
+        store.add(rec);
+        if (m_checkpoint) unmarked.emplace_back(rec.frame, rec.output);
+        if (!csv) return;
+        // 部分完成的帧整帧重算，已登记的输出不再重复写行
+        if (m_resumed && m_manifest.isDone(rec.frame, rec.output)) return;
+        Output& out = outputs[rec.output];
+        if (out.failed) return;
+
+        const int len = std::snprintf(num, sizeof(num), "%.6f", rec.value);
+        QByteArray& dst = holdRows ? out.held[rec.frame] : out.buffer;
+        dst.append(m_labels[rec.frame]).append(',').append(num, len).append('\n');
+        if (out.buffer.size() >= kFlushBytes) {
+            out.file->write(out.buffer);
+            out.buffer.clear();
+        }
+    };
+
+    QElapsedTimer sinceCheckpoint;
+    sinceCheckpoint.start();
+    ResultRecord rec;
+    for (;;) {
+        // 先读关闭标志再排空：endSession 在所有生产者结束后才置位，排空后即可安全退出
+        const bool closing = m_closing.load();
+        int drained = 0;
+        while (!m_isAborted && m_queue.tryPop(rec)) {
+            write(rec);
+            ++drained;
+        }
+        if (m_isAborted || closing) break;
+        if (m_checkpoint && sinceCheckpoint.elapsed() >= kCheckpointMs) {
+            checkpoint();
+            sinceCheckpoint.restart();
+        }
+        if (drained == 0) QThread::usleep(200);
     }
 
-    m_expectedResults--;
-    if (m_expectedResults <= 0) {
-        emit allResultsSaved();
+    // 中止时丢弃缓冲并保留上一个检查点，续写时从那里重算
+    if (!m_isAborted) {
+        for (Output& out : outputs) {
+            if (!out.file || out.failed || out.buffer.isEmpty()) continue;
+            out.file->write(out.buffer);
+            out.buffer.clear();
+        }
+    }
+    store.close();
+    if (m_checkpoint && !m_isAborted) checkpoint();
+    for (Output& out : outputs) {
+        if (!out.file || out.failed) continue;
+        out.file->flush(); // 显式刷盘
+        out.file->close();
     }
 }
@@ -1,82 +1,150 @@
 #ifndef TASK_H
 #define TASK_H
 
-#include <QRunnable>
 #include <QObject>
-#include <QFile>
-#include <QTextStream>
 #include <QMap>
-#include <QSharedPointer>
 #include <QDir>
-#include <QMutex>
+#include <QThread>
+#include <atomic>
 #include <opencv2/opencv.hpp>
 
+#include "ImgPcAlg.h"
+#include "bufferpool.h"
+#include "resultchannel.h"
+#include "checkpoint.h"
+#include "resultstore.h"
+
+// 读取独立持有数据的灰度图（内存映射 + 零拷贝解码，见 ImageIO）
 cv::Mat imread_safe(const QString& path);
 
-// 结果收集器：负责将不同线程产生的数据分类写入文件
+class AlgInterface;
+// 会话级预构建的算法实例：参考图在 ProcessingSession::start() 中只处理一次，
+// 之后由所有工作线程只读共享（process() 为 const）
+using PreparedAlgs = QMap<QString, std::shared_ptr<const AlgInterface>>;
+
+// 结果收集器：计算线程经无锁队列直接提交结果记录，由专用写出线程按输出分类批量写入文件，
+// GUI 线程不在数据通路上
 class ResultCollector : public QObject {
     Q_OBJECT
 public:
     explicit ResultCollector(QObject* parent = nullptr) : QObject(parent) {}
     ~ResultCollector() { closeAll(); }
 
+    // 结果文件格式，可组合
+    enum Format {
+        Csv = 0x1,       // 每个输出一个 "输出名.csv"
+        Binary = 0x2,    // 全部输出写入一个列式 results.dipres（见 resultstore.h）
+    };
+
     void setOutputDir(QString path);
+    void setFormats(int formats) { m_formats = formats; }
+    // 输出目录中存在同一会话的检查点时跳过已完成的帧，默认开启；关闭后从头计算并追加到已有 CSV
+    void setResume(bool resume) { m_resume = resume; }
+    // 逐像素结果图（局部相关图等）的写出倍率：1 为原分辨率，n 为按面积下采样 n 倍，0 表示不写
+    void setMapScale(int scale) { m_mapScale = std::max(0, scale); }
+    bool wantsMaps() const { return m_mapScale > 0; }
     void prepare(); // 准备工作：检查并创建目录
     void closeAll();
     void abort();
 
-    void resetExpectedCount(int count);
-    void decrementExpectedCount(int count);
+    // 会话开始：登记输出名与帧标识（记录中的序号据此解析），启动写出线程。
+    // fingerprint 标识会话的全部输入，非空时启用检查点，与已有清单一致则续写
+    void beginSession(const QVector<QString>& outputNames, const QStringList& frameLabels,
+                      const QByteArray& fingerprint = QByteArray());
+    // 上次运行已全部完成的帧（按帧序号），beginSession 之后有效
+    const std::vector<char>& completedFrames() const { return m_completed; }
+    // 任意线程调用，无锁；队列满时让出时间片等待写出线程追上
+    void push(int frame, int output, double value);
+    // 该帧的结果已全部 push，二进制结果据此按帧序写出
+    void frameDone(int frame) { push(frame, kFrameDoneOutput, 0.0); }
+    // 任意线程调用：结果图数据量大，直接按帧槽位写入 "输出名.dipmap"，不经过队列
+    void pushMap(int frame, int output, const cv::Mat& map);
+    // 排空队列、刷盘并结束写出线程
+    void endSession();
 
-public slots:
-    // 增加 fileName 参数，让结果知道对应哪张图
-    void handleResult(QString algName, QString fileName, double value);
+signals:
+    void allResultsSaved();
 
 private:
-    QMutex m_mutex;
-    std::atomic<int> m_expectedResults{0};
+    void writerLoop();
+
+    MpscQueue<ResultRecord> m_queue;
     std::atomic<bool> m_isAborted{false};
+    std::atomic<bool> m_closing{false};
+    QThread* m_writer = nullptr;
 
     QString m_outputDir;
-    QMap<QString, QSharedPointer<QFile>> m_files;
-    QMap<QString, QSharedPointer<QTextStream>> m_streams;
-
-signals:
-    void allResultsSaved();
+    int m_formats = Csv;
+    QVector<QString> m_outputNames;
+    std::vector<QByteArray> m_labels; // UTF-8 帧标识，会话期间只读
+
+    bool m_resume = true;
+    bool m_checkpoint = false;        // 本会话写检查点
+    bool m_resumed = false;           // 本会话接续上次的检查点
+    SessionManifest m_manifest;       // 会话期间仅写出线程访问
+    ResultStore::Writer m_store;      // 同上
+
+    int m_mapScale = 1;
+    QMutex m_mapMutex;                // 保护 m_maps 的惰性创建
+    std::vector<std::unique_ptr<ResultStore::MapWriter>> m_maps;
+    std::vector<char> m_completed;
 };
 
 /*************************************************/
-class ProcessingSession;
-// 具体的处理任务
-class ProcessingTask : public QObject, public QRunnable {
-    Q_OBJECT
+// 单帧计算：会话内所有计算线程只读共享同一个实例
+class FrameProcessor {
 public:
-    // 传递算法名称和参考图，而不是直接传递算法实例，以保证线程安全
-    ProcessingTask(QString imgPath, QVector<QString> algNames, cv::Mat refImg)
-        : m_path(imgPath), m_algNames(algNames), m_refImg(refImg) {
-        setAutoDelete(true);
-    }
-
-    void run() override;
-    void setPCancelled(std::shared_ptr<std::atomic<bool>> pFlag) {m_pCancelled = pFlag;}
-    void setROI(cv::Rect roi) {m_roi = roi;}
+    // 子区域：rect 相对解码后的图像（空表示整幅），prepared 为用该区域参考图构建的算法实例
+    struct Region {
+        QString id;        // 非空时输出名追加 "@id"
+        cv::Rect rect;
+        PreparedAlgs prepared;
+    };
+
+    // 传递算法名称与会话内共享的只读算法实例，参考图侧的预处理不再随每张图重复
+    FrameProcessor(QVector<QString> algNames, PreparedAlgs prepared, GLCM::GLCMRequest glcmReq);
+    // 多区域：每帧解码一次，逐区域计算全部算法；输出按区域分块排列
+    FrameProcessor(QVector<QString> algNames, QVector<Region> regions, GLCM::GLCMRequest glcmReq);
+
+    // 计算一帧的全部输出 (输出序号, 值)；被取消时提前返回 false，已算出的部分保留在 results 中。
+    // maps 非空时同时收集产出逐像素结果图的算法的图 (输出序号, CV_32F)
+    bool process(const cv::Mat& img, QVector<QPair<int, double>>& results,
+                 const std::atomic<bool>* cancelled = nullptr, QVector<QPair<int, cv::Mat>>* maps = nullptr) const;
+    // 同上，整幅图的中间量由调用方持有，计算后可继续复用（如滞后帧对相关）
+    bool process(FrameContext& frame, QVector<QPair<int, double>>& results,
+                 const std::atomic<bool>* cancelled = nullptr, QVector<QPair<int, cv::Mat>>* maps = nullptr) const;
+
+    // 含附加输出在内的每帧结果数
+    int outputsPerFrame() const { return m_outputNames.size(); }
+    // 按输出序号排列的输出名（算法名，附加输出为 "算法名+后缀"，多区域时再加 "@区域"）
+    const QVector<QString>& outputNames() const { return m_outputNames; }
 
 private:
-    std::shared_ptr<std::atomic<bool>> m_pCancelled = nullptr;
-    cv::Rect m_roi;
+    // 一个区域内的全部算法，输出序号从 first 开始
+    bool processRegion(FrameContext& frame, const Region& region, int first, QVector<QPair<int, double>>& results,
+                       const std::atomic<bool>* cancelled, QVector<QPair<int, cv::Mat>>* maps) const;
 
-    QString m_path;
     QVector<QString> m_algNames;
-    cv::Mat m_refImg;
-
-signals:
-    void resultReady(QString algName, QString fileName, double value);
-    void finished();
-    void errorOccurred(QString msg);
-    void resultsSkipped(unsigned size);
+    QVector<Region> m_regions;
+    QVector<int> m_auxCount;      // 各算法的附加输出数
+    int m_outputsPerRegion = 0;
+    GLCM::GLCMRequest m_glcmReq;
+    bool m_needsGlcm = false;
+    QVector<QString> m_outputNames;
 };
 
 /****************************************************/
+class FramePipeline;
+
+// 流水线各阶段配置
+struct PipelineConfig {
+    int ioThreads = 2;       // 预读文件字节
+    int decodeThreads = 2;   // 解码与 ROI 裁切
+    int computeThreads = 0;  // 0 表示沿用全局线程池的上限
+    int queueDepth = 0;      // 阶段间队列容量（帧数），0 表示取计算线程数的 2 倍
+    int chunkFrames = 0;     // 工作单元的连续帧数，0 表示按帧数与计算线程数自动选取
+};
+
 class ProcessingSession : public QObject {
     Q_OBJECT
 public:
@@ -86,15 +154,37 @@ public:
         m_pCancelled = std::make_shared<std::atomic<bool>>(false);
     }
 
+    ~ProcessingSession();
+
     void start(const cv::Mat& refImg, const QStringList& files, const QDir& dir, const QVector<QString>& algs);
     void setROI(cv::Rect roi) { roi4Task = roi; }
+    // 在 ROI（未设置时为整幅图）内再划分的子区域，坐标相对 ROI，与传入 start() 的参考图一致。
+    // 每帧只解码一次 ROI，所有子区域共享；输出名为 "算法名@R<序号>"
+    void setRegions(const QVector<cv::Rect>& regions) { m_regions = regions; }
+    // 在 area 内按 cell 大小、stride 步距（默认不重叠）行优先铺满的网格子区域
+    static QVector<cv::Rect> gridRegions(cv::Size area, cv::Size cell, cv::Size stride = cv::Size());
+    // 读取 / 解码 / 计算各阶段的线程数与队列深度
+    void setPipelineConfig(const PipelineConfig& cfg) { m_pipelineCfg = cfg; }
+    // GLCM 的偏移与灰度级集合，默认 32 级、(1, 0)
+    void setGLCMRequest(const GLCM::GLCMRequest& req) { m_glcmReq = req; }
+    // 影响结果但不经过会话的参数（如 ZNCCshift 搜索半径），计入检查点指纹
+    void setResumeTag(const QByteArray& tag) { m_resumeTag = tag; }
+    // 多尺度：MSV / NIPC / ZNCC 在每个下采样因子上各求一次，输出名 "NIPC_x4"；
+    // 每帧只解码一次，2 的幂因子由同一金字塔逐级得到
+    void setScales(const QVector<int>& factors);
+    // 滞后帧对：除固定参考外，另计算帧 i 与 i-k 之间的 NIPC / ZNCC（随所选算法），输出名 "NIPC_lag<k>"
+    void setLags(const QVector<int>& lags);
     std::shared_ptr<std::atomic<bool>> getPCancelled() const {return m_pCancelled;}
+
+    // 基于参考图一次性构建本会话所需的算法实例；构建失败的算法被剔除出 algs
+    static PreparedAlgs prepareAlgs(const cv::Mat& refImg, QVector<QString>& algs, const GLCM::GLCMRequest& glcmReq);
 signals:
     void sessionFinished(); // 整个批处理完成
     void progressUpdated(int current, int total); // 可选：进度条支持
 
 private slots:
-    void onTaskFinished();
+    void onProgress(int done);
+    void onPipelineFinished();
 
 public slots:
     void cancel();
@@ -104,8 +194,16 @@ private:
 
     ResultCollector* m_collector;
     cv::Rect roi4Task;
+    QVector<cv::Rect> m_regions;
+    GLCM::GLCMRequest m_glcmReq;
+    PipelineConfig m_pipelineCfg;
+    QByteArray m_resumeTag;
+    QVector<int> m_lags;
+    QVector<int> m_scales;
+    FramePipeline* m_pipeline = nullptr;
     int m_activeTasks;
     int m_totalTasks;
+    BufferPool::Stats m_poolBase;
 };
 
 // 任务管理器
@@ -0,0 +1,114 @@
+#include "temporal.h"
+#include "task.h"
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+
+TemporalCorrelator::TemporalCorrelator(QVector<int> lags, bool nipc, bool zncc, int frames, int firstOutput, int f)
+    : m_lags(std::move(lags)), m_nipc(nipc), m_zncc(zncc), m_frames(std::max(0, frames)),
+      m_firstOutput(firstOutput), m_factor(std::max(1, f))
+{
+    m_arrived.assign(m_frames, 0);
+    m_backPending.assign(m_frames, 0);
+    m_unresolved.assign(m_frames, 0);
+    for (int i = 0; i < m_frames; ++i) {
+        for (int k : m_lags) {
+            if (i - k >= 0) { ++m_backPending[i]; ++m_unresolved[i]; }
+            if (i + k < m_frames) ++m_unresolved[i];
+        }
+    }
+}
+
+int TemporalCorrelator::outputCount() const
+{
+    return m_lags.size() * ((m_nipc ? 1 : 0) + (m_zncc ? 1 : 0));
+}
+
+QVector<QString> TemporalCorrelator::outputNames() const
+{
+    QVector<QString> names;
+    for (int k : m_lags) {
+        if (m_nipc) names.append(QString("%1_lag%2").arg(NIPCNAME).arg(k));
+        if (m_zncc) names.append(QString("%1_lag%2").arg(ZNCCNAME).arg(k));
+    }
+    return names;
+}
+
+std::shared_ptr<const TemporalCorrelator::Features> TemporalCorrelator::lookup(int index) const
+{
+    auto it = m_window.find(index);
+    return it == m_window.end() ? nullptr : it->second;
+}
+
+void TemporalCorrelator::addFrame(int index, FrameContext* frame, ResultCollector* collector)
+{
+    if (index < 0 || index >= m_frames) return;
+
+    // 预处理结果取自该帧的 FrameContext：固定参考算法已算过的梯度直接复用
+    std::shared_ptr<Features> feat;
+    if (frame && !frame->empty()) {
+        try {
+            feat = std::make_shared<Features>();
+            frame->downGradient(m_factor).copyTo(feat->grad);
+            feat->norm = frame->downGradientNorm(m_factor);
+            frame->downGradientMeanStd(m_factor, feat->mean, feat->stddev);
+        }
+        catch (const std::exception& e) {
+            qDebug() << "TemporalError:" << index << e.what();
+            feat.reset();
+        }
+    }
+
+    // 帧对由后到达的一方认领，锁内只登记，相关计算在锁外进行
+    std::vector<Pair> pairs;
+    std::vector<int> markers;
+    {
+        QMutexLocker locker(&m_mutex);
+        m_arrived[index] = 1;
+        for (int l = 0; l < m_lags.size(); ++l) {
+            const int k = m_lags[l];
+            if (index - k >= 0 && m_arrived[index - k])
+                pairs.push_back({index, index - k, l, feat, lookup(index - k)});
+            if (index + k < m_frames && m_arrived[index + k])
+                pairs.push_back({index + k, index, l, lookup(index + k), feat});
+        }
+        // 还有伙伴未到达时留在窗口中
+        if (feat && m_unresolved[index] > static_cast<int>(pairs.size())) m_window[index] = feat;
+        if (m_backPending[index] == 0) markers.push_back(index);
+    }
+
+    for (const Pair& pair : pairs) emitPair(pair, collector);
+
+    {
+        QMutexLocker locker(&m_mutex);
+        for (const Pair& pair : pairs) {
+            if (--m_backPending[pair.newer] == 0) markers.push_back(pair.newer);
+            for (int side : { pair.newer, pair.older }) {
+                if (--m_unresolved[side] == 0) m_window.erase(side);
+            }
+        }
+    }
+
+    // 该帧的全部滞后结果已入队，之后才发出结束标记
+    if (collector) {
+        for (int m : markers) collector->frameDone(m);
+    }
+}
+
+void TemporalCorrelator::emitPair(const Pair& pair, ResultCollector* collector) const
+{
+    if (!collector || !pair.a || !pair.b || pair.a->grad.size() != pair.b->grad.size()) return;
+    const double dot = pair.a->grad.dot(pair.b->grad);
+    const double n = static_cast<double>(pair.a->grad.total());
+
+    int output = m_firstOutput + pair.lagIndex * ((m_nipc ? 1 : 0) + (m_zncc ? 1 : 0));
+    if (m_nipc) {
+        const double denom = pair.a->norm * pair.b->norm;
+        collector->push(pair.newer, output++, denom < 1e-12 ? 0.0 : std::clamp(dot / denom, -1.0, 1.0));
+    }
+    if (m_zncc) {
+        const double denom = n * pair.a->stddev * pair.b->stddev;
+        const double val = denom < 1e-12 ? 0.0 : (dot - n * pair.a->mean * pair.b->mean) / denom;
+        collector->push(pair.newer, output, std::isnan(val) ? 0.0 : std::clamp(val, -1.0, 1.0));
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef TEMPORAL_H
+#define TEMPORAL_H
+
+#include <QMutex>
+#include <QString>
+#include <QVector>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "ImgPcAlg.h"
+#include "pipeline.h"
+
+/**
+ * @brief 滚动参考 / 滞后帧对相关
+ * 帧 i 与 i-k（k 取自 lags）之间的 NIPC / ZNCC。每帧的下采样梯度及其范数、均值、标准差
+ * 只在该帧的计算线程中算一次，放入按帧序号索引的滑动窗口，供所有滞后复用；
+ * 帧对由两帧中后到达的一方计算，窗口中的帧在其全部后继帧对完成后立即释放。
+ * 计算线程乱序处理，窗口只保留尚有后继未到达的帧，规模由流水线的乱序程度决定。
+ *
+ * 输出名为 "NIPC_lag<k>" / "ZNCC_lag<k>"，值记在较新的帧 i 上，i < k 的帧没有该输出。
+ * 帧的全部滞后结果提交后才向收集器发出该帧的结束标记。
+ */
+class TemporalCorrelator : public FrameSink {
+public:
+    TemporalCorrelator(QVector<int> lags, bool nipc, bool zncc, int frames, int firstOutput, int f = factor);
+
+    // 按输出序号排列的输出名，序号从 firstOutput 开始
+    QVector<QString> outputNames() const;
+    int outputCount() const;
+    const QVector<int>& lags() const { return m_lags; }
+
+    // 计算线程调用：帧 index 已计算完毕（frame 为空表示读取 / 解码失败或被跳过），
+    // 完成的帧对结果与帧结束标记直接提交给 collector
+    void addFrame(int index, FrameContext* frame, ResultCollector* collector) override;
+
+private:
+    struct Features {
+        cv::Mat grad;       // 下采样梯度（CV_32F）
+        double norm = 0;
+        double mean = 0;
+        double stddev = 0;
+    };
+    struct Pair {
+        int newer, older, lagIndex;
+        std::shared_ptr<const Features> a, b;
+    };
+
+    void emitPair(const Pair& pair, ResultCollector* collector) const;
+    std::shared_ptr<const Features> lookup(int index) const;
+
+    QVector<int> m_lags;
+    bool m_nipc, m_zncc;
+    int m_frames;
+    int m_firstOutput;
+    int m_factor;
+
+    QMutex m_mutex;
+    std::vector<char> m_arrived;
+    std::vector<int> m_backPending;   // 以该帧为较新一方、尚未完成的帧对数
+    std::vector<int> m_unresolved;    // 涉及该帧、尚未完成的帧对数，归零后移出窗口
+    std::unordered_map<int, std::shared_ptr<const Features>> m_window;
+};
+
+#endif // TEMPORAL_H
@@ -0,0 +1,116 @@
+#include "twotime.h"
+#include "task.h"
+#include <QDebug>
+#include <QThread>
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+TwoTimeCorrelator::TwoTimeCorrelator(int frames, int f)
+    : m_frames(std::max(0, frames)), m_factor(std::max(1, f))
+{
+}
+
+bool TwoTimeCorrelator::ensureOpen(cv::Size size)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_features.isOpen() && !m_failed) m_failed = !m_features.open(m_path, m_frames, size);
+    return !m_failed;
+}
+
+void TwoTimeCorrelator::addFrame(int index, FrameContext* frame, ResultCollector* collector)
+{
+    if (frame && !frame->empty() && index >= 0 && index < m_frames) {
+        try {
+            // 与 NIPCAlg 相同的预处理：下采样梯度除以其 L2 范数
+            const double norm = frame->downGradientNorm(m_factor);
+            if (norm > 1e-12) {
+                cv::Mat unit;
+                frame->downGradient(m_factor).convertTo(unit, CV_32F, 1.0 / norm);
+                if (ensureOpen(unit.size()) && !m_features.write(index, unit))
+                    qDebug() << "TwoTimeError: frame size differs from the first frame:" << index;
+            }
+        }
+        catch (const std::exception& e) {
+            qDebug() << "TwoTimeError:" << index << e.what();
+        }
+    }
+    if (collector) collector->frameDone(index);
+}
+
+void TwoTimeCorrelator::closeFeatures()
+{
+    m_features.close();
+}
+
+bool TwoTimeCorrelator::computeMatrix(const QString& featurePath, const QString& outPath, int threads, int tile,
+                                      const std::atomic<bool>* cancelled)
+{
+    ResultStore::MapReader features;
+    if (!features.open(featurePath)) {
+        qDebug() << "Failed to open feature file:" << featurePath;
+        return false;
+    }
+    const qint64 n = features.frameCount();
+    ResultStore::MatrixWriter out;
+    if (!out.open(outPath, n, n)) return false;
+
+    tile = std::max(1, tile);
+    const int tiles = static_cast<int>((n + tile - 1) / tile);
+    // 只算上三角块，C 对称，下三角由转置镜像得到
+    std::vector<std::pair<int, int>> blocks;
+    for (int i = 0; i < tiles; ++i) {
+        for (int j = i; j < tiles; ++j) blocks.emplace_back(i, j);
+    }
+    std::vector<char> valid(n);
+    for (qint64 f = 0; f < n; ++f) valid[f] = features.hasFrame(f);
+
+    std::atomic<size_t> next{0};
+    std::atomic<bool> ok{true};
+    auto worker = [&]() {
+        const float nan = std::numeric_limits<float>::quiet_NaN();
+        cv::Mat c, ct;
+        for (size_t b = next.fetch_add(1); b < blocks.size(); b = next.fetch_add(1)) {
+            if ((cancelled && cancelled->load()) || !ok) return;
+            const qint64 r0 = qint64(blocks[b].first) * tile;
+            const qint64 c0 = qint64(blocks[b].second) * tile;
+            const int rn = static_cast<int>(std::min<qint64>(tile, n - r0));
+            const int cn = static_cast<int>(std::min<qint64>(tile, n - c0));
+
+            // 两块特征直接引用映射区，C_block = A · Bᵀ
+            cv::gemm(features.frames(r0, rn), features.frames(c0, cn), 1.0, cv::noArray(), 0.0, c, cv::GEMM_2_T);
+            // 浮点累加误差可能使结果略超出 [-1, 1]
+            cv::max(c, -1.0, c);
+            cv::min(c, 1.0, c);
+            for (int r = 0; r < rn; ++r) {
+                if (!valid[r0 + r]) c.row(r).setTo(nan);
+            }
+            for (int k = 0; k < cn; ++k) {
+                if (!valid[c0 + k]) c.col(k).setTo(nan);
+            }
+
+            bool written = out.writeBlock(r0, c0, c);
+            if (r0 != c0) {
+                cv::transpose(c, ct);
+                written = written && out.writeBlock(c0, r0, ct);
+            }
+            if (!written) ok = false;
+        }
+    };
+
+    if (threads <= 0) threads = QThread::idealThreadCount();
+    threads = std::max(1, std::min<int>(threads, static_cast<int>(blocks.size())));
+    std::vector<QThread*> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.push_back(QThread::create(worker));
+        workers.back()->start();
+    }
+    for (QThread* t : workers) {
+        t->wait();
+        delete t;
+    }
+    out.close();
+
+    if (!ok) qDebug() << "Failed to write matrix file:" << outPath;
+    return ok && !(cancelled && cancelled->load());
+}
@@ -0,0 +1,44 @@
+#ifndef TWOTIME_H
+#define TWOTIME_H
+
+#include <QMutex>
+#include <QString>
+#include <atomic>
+
+#include "ImgPcAlg.h"
+#include "pipeline.h"
+#include "resultstore.h"
+
+/**
+ * @brief 双时间相关矩阵 C(t1, t2)：序列中任意两帧之间的 NIPC
+ * NIPC 是两帧下采样梯度的归一化点积，每帧归一化为单位向量后 C = F·Fᵀ。
+ * 第一遍经 FramePipeline 逐帧解码一次，单位向量写入特征文件（.dipmap 格式，一帧一行）；
+ * 第二遍按 tile×tile 帧分块，多线程计算上三角块的矩阵乘法并镜像写出到 .dipmat。
+ * 特征与结果矩阵都经内存映射访问，常驻内存由页缓存调度，矩阵可以大于内存。
+ * 读取 / 解码失败的帧所在行列为 NaN。
+ */
+class TwoTimeCorrelator : public FrameSink {
+public:
+    explicit TwoTimeCorrelator(int frames, int f = factor);
+
+    // 第一遍：特征文件在第一帧到达时按其尺寸建立
+    void setFeatureFile(const QString& path) { m_path = path; }
+    void addFrame(int index, FrameContext* frame, ResultCollector* collector) override;
+    void closeFeatures();
+
+    // 第二遍：tile 为每块的帧数；块按行优先领取，并发的线程多半共用同一行块，特征少重读
+    static bool computeMatrix(const QString& featurePath, const QString& outPath, int threads, int tile = 256,
+                              const std::atomic<bool>* cancelled = nullptr);
+
+private:
+    bool ensureOpen(cv::Size size);
+
+    int m_frames;
+    int m_factor;
+    QString m_path;
+    QMutex m_mutex;            // 保护特征文件的延迟建立
+    bool m_failed = false;
+    ResultStore::MapWriter m_features;
+};
+
+#endif // TWOTIME_H